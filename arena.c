@@ -0,0 +1,155 @@
+/*
+    fp - arena.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* every allocation is aligned for long double */
+#define ARENA_ALIGN 16
+
+/* header of a block, rounded up to the alignment */
+#define BLOCK_HEADER \
+    ((sizeof(struct Block) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+static struct Block *new_block(size_t size)
+{
+    struct Block *b;
+
+    if ((b = malloc(BLOCK_HEADER + size)) == NULL) {
+        perror("malloc(block)");
+        exit(EXIT_FAILURE);
+    }
+
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+
+    return (b);
+}
+
+static void delete_blocks(struct Block *b)
+{
+    struct Block *next;
+
+    while (b != NULL) {
+        next = b->next;
+        free(b);
+        b = next;
+    }
+}
+
+struct Arena *new_arena(void)
+{
+    struct Arena *a;
+
+    if ((a = malloc(sizeof(struct Arena))) == NULL) {
+        perror("malloc(arena)");
+        exit(EXIT_FAILURE);
+    }
+
+    a->first = new_block(ARENA_BLOCK_SIZE);
+    a->current = a->first;
+    a->large = NULL;
+
+    return (a);
+}
+
+/* allocates zeroed memory from an arena
+ * 1. argument: pointer of the arena
+ * 2. argument: number of bytes
+ * return value: pointer to the memory */
+void *arena_alloc(struct Arena *a, size_t size)
+{
+    struct Block *b;
+    char *p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    /* big chunks get a block of their own */
+    if (size > ARENA_BLOCK_SIZE / 4) {
+        b = new_block(size);
+        b->next = a->large;
+        a->large = b;
+
+        p = (char *) b + BLOCK_HEADER;
+        memset(p, 0, size);
+
+        return (p);
+    }
+
+    b = a->current;
+
+    if (b->used + size > b->size) {
+        /* reuse the blocks of an earlier reset before allocating new ones */
+        if (b->next == NULL)
+            b->next = new_block(ARENA_BLOCK_SIZE);
+
+        b = b->next;
+        b->used = 0;
+        a->current = b;
+    }
+
+    p = (char *) b + BLOCK_HEADER + b->used;
+    b->used += size;
+
+    memset(p, 0, size);
+
+    return (p);
+}
+
+char *arena_strdup(struct Arena *a, const char *s)
+{
+    size_t len;
+    char *p;
+
+    len = strlen(s) + 1;
+    p = arena_alloc(a, len);
+
+    return (memcpy(p, s, len));
+}
+
+/* releases everything that was allocated from an arena at once,
+ * the blocks are kept for the next allocations
+ * 1. argument: pointer of the arena
+ * return value: none */
+void reset_arena(struct Arena *a)
+{
+    if (a == NULL)
+        return;
+
+    delete_blocks(a->large);
+    a->large = NULL;
+
+    a->current = a->first;
+    a->current->used = 0;
+}
+
+void delete_arena(struct Arena *a)
+{
+    if (a == NULL)
+        return;
+
+    delete_blocks(a->large);
+    delete_blocks(a->first);
+    free(a);
+}
@@ -0,0 +1,47 @@
+/*
+    fp - arena.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_ARENA_H
+#define FP_ARENA_H
+
+#include <stddef.h>
+
+/* size of one block of an arena */
+#define ARENA_BLOCK_SIZE 65536
+
+struct Block {
+    struct Block *next;
+    size_t size;
+    size_t used;
+};
+
+struct Arena {
+    struct Block *first;
+    struct Block *current;
+    struct Block *large;
+};
+
+extern struct Arena *new_arena(void);
+extern void *arena_alloc(struct Arena *, size_t);
+extern char *arena_strdup(struct Arena *, const char *);
+extern void reset_arena(struct Arena *);
+extern void delete_arena(struct Arena *);
+
+#endif
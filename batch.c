@@ -0,0 +1,596 @@
+/*
+    fp - batch.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "program.h"
+#include "batch.h"
+#include "bindings.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+/* vector operations on columns of n doubles */
+struct Kernels {
+    const char *name;
+    void (*add) (double *, const double *, const double *, size_t);
+    void (*sub) (double *, const double *, const double *, size_t);
+    void (*mul) (double *, const double *, const double *, size_t);
+    void (*div) (double *, const double *, const double *, size_t);
+    void (*select) (double *, const double *, const double *,
+                    const double *, size_t);
+};
+
+/* one column operation for every instruction set
+ * NAME: name of the function, TARGET: function attributes,
+ * VEC: vector type, W: doubles per vector, LOAD/STORE: unaligned access,
+ * OP: vector operation, COP: C operator for the remaining rows */
+#define BINARY_KERNEL(NAME, TARGET, VEC, W, LOAD, STORE, OP, COP)      \
+static TARGET void NAME(double *r, const double *a, const double *b,   \
+                        size_t n)                                       \
+{                                                                       \
+    size_t i;                                                           \
+                                                                        \
+    for (i = 0; i + W <= n; i += W) {                                   \
+        VEC x = LOAD(a + i), y = LOAD(b + i);                           \
+        STORE(r + i, OP(x, y));                                         \
+    }                                                                   \
+                                                                        \
+    for (; i < n; i++)                                                  \
+        r[i] = a[i] COP b[i];                                           \
+}
+
+static void generic_add(double *r, const double *a, const double *b,
+                        size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        r[i] = a[i] + b[i];
+}
+
+static void generic_sub(double *r, const double *a, const double *b,
+                        size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        r[i] = a[i] - b[i];
+}
+
+static void generic_mul(double *r, const double *a, const double *b,
+                        size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        r[i] = a[i] * b[i];
+}
+
+static void generic_div(double *r, const double *a, const double *b,
+                        size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        r[i] = a[i] / b[i];
+}
+
+static void generic_select(double *r, const double *c, const double *t,
+                           const double *f, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        r[i] = c[i] ? t[i] : f[i];
+}
+
+static const struct Kernels generic_kernels = {
+    "generic", generic_add, generic_sub, generic_mul, generic_div,
+    generic_select
+};
+
+#ifdef BATCH_X86
+
+#define SSE2   __attribute__ ((target("sse2")))
+#define AVX2   __attribute__ ((target("avx2")))
+#define AVX512 __attribute__ ((target("avx512f")))
+
+BINARY_KERNEL(sse2_add, SSE2, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd,
+              _mm_add_pd, +)
+BINARY_KERNEL(sse2_sub, SSE2, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd,
+              _mm_sub_pd, -)
+BINARY_KERNEL(sse2_mul, SSE2, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd,
+              _mm_mul_pd, *)
+BINARY_KERNEL(sse2_div, SSE2, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd,
+              _mm_div_pd, /)
+
+BINARY_KERNEL(avx2_add, AVX2, __m256d, 4, _mm256_loadu_pd,
+              _mm256_storeu_pd, _mm256_add_pd, +)
+BINARY_KERNEL(avx2_sub, AVX2, __m256d, 4, _mm256_loadu_pd,
+              _mm256_storeu_pd, _mm256_sub_pd, -)
+BINARY_KERNEL(avx2_mul, AVX2, __m256d, 4, _mm256_loadu_pd,
+              _mm256_storeu_pd, _mm256_mul_pd, *)
+BINARY_KERNEL(avx2_div, AVX2, __m256d, 4, _mm256_loadu_pd,
+              _mm256_storeu_pd, _mm256_div_pd, /)
+
+BINARY_KERNEL(avx512_add, AVX512, __m512d, 8, _mm512_loadu_pd,
+              _mm512_storeu_pd, _mm512_add_pd, +)
+BINARY_KERNEL(avx512_sub, AVX512, __m512d, 8, _mm512_loadu_pd,
+              _mm512_storeu_pd, _mm512_sub_pd, -)
+BINARY_KERNEL(avx512_mul, AVX512, __m512d, 8, _mm512_loadu_pd,
+              _mm512_storeu_pd, _mm512_mul_pd, *)
+BINARY_KERNEL(avx512_div, AVX512, __m512d, 8, _mm512_loadu_pd,
+              _mm512_storeu_pd, _mm512_div_pd, /)
+
+/* r = c ? t : f, NaN counts as true like in C */
+static SSE2 void sse2_select(double *r, const double *c, const double *t,
+                             const double *f, size_t n)
+{
+    __m128d m;
+    size_t i;
+
+    for (i = 0; i + 2 <= n; i += 2) {
+        m = _mm_cmpneq_pd(_mm_loadu_pd(c + i), _mm_setzero_pd());
+        _mm_storeu_pd(r + i, _mm_or_pd(_mm_and_pd(m, _mm_loadu_pd(t + i)),
+                                       _mm_andnot_pd(m,
+                                                     _mm_loadu_pd(f + i))));
+    }
+
+    for (; i < n; i++)
+        r[i] = c[i] ? t[i] : f[i];
+}
+
+static AVX2 void avx2_select(double *r, const double *c, const double *t,
+                             const double *f, size_t n)
+{
+    __m256d m;
+    size_t i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        m = _mm256_cmp_pd(_mm256_loadu_pd(c + i), _mm256_setzero_pd(),
+                          _CMP_NEQ_UQ);
+        _mm256_storeu_pd(r + i, _mm256_blendv_pd(_mm256_loadu_pd(f + i),
+                                                 _mm256_loadu_pd(t + i),
+                                                 m));
+    }
+
+    for (; i < n; i++)
+        r[i] = c[i] ? t[i] : f[i];
+}
+
+static AVX512 void avx512_select(double *r, const double *c,
+                                 const double *t, const double *f,
+                                 size_t n)
+{
+    __mmask8 m;
+    size_t i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        m = _mm512_cmp_pd_mask(_mm512_loadu_pd(c + i),
+                               _mm512_setzero_pd(), _CMP_NEQ_UQ);
+        _mm512_storeu_pd(r + i, _mm512_mask_blend_pd(m,
+                                                     _mm512_loadu_pd(f + i),
+                                                     _mm512_loadu_pd(t +
+                                                                     i)));
+    }
+
+    for (; i < n; i++)
+        r[i] = c[i] ? t[i] : f[i];
+}
+
+static const struct Kernels sse2_kernels = {
+    "sse2", sse2_add, sse2_sub, sse2_mul, sse2_div, sse2_select
+};
+
+static const struct Kernels avx2_kernels = {
+    "avx2", avx2_add, avx2_sub, avx2_mul, avx2_div, avx2_select
+};
+
+static const struct Kernels avx512_kernels = {
+    "avx512", avx512_add, avx512_sub, avx512_mul, avx512_div,
+    avx512_select
+};
+
+#endif
+
+/* chooses the kernels for the cpu we are running on */
+static const struct Kernels *kernels(void)
+{
+    static const struct Kernels *k = NULL;
+
+    if (k != NULL)
+        return (k);
+
+    k = &generic_kernels;
+
+#ifdef BATCH_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f"))
+        k = &avx512_kernels;
+    else if (__builtin_cpu_supports("avx2"))
+        k = &avx2_kernels;
+    else if (__builtin_cpu_supports("sse2"))
+        k = &sse2_kernels;
+#endif
+
+    return (k);
+}
+
+const char *batch_kernels(void)
+{
+    return (kernels()->name);
+}
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p;
+
+    if ((p = calloc(n ? n : 1, size)) == NULL) {
+        perror("calloc(batch)");
+        exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+/* an open conditional while running a block */
+struct Branch {
+    uint32_t end;               /* instruction behind the false branch */
+    double *condition;
+};
+
+/* runs a program over many rows at once
+ * every instruction works on a whole block of rows, both branches of a
+ * conditional are calculated and the results are selected per row
+ * 1. argument: pointer of the program
+ * 2. argument: columns with the values of a-z
+ * 3. argument: values of the variables without a column (NULL: all 0)
+ * 4. argument: number of rows
+ * 5. argument: array for the results of all rows
+ * return value: none */
+void run_program_columns(struct Program *p, double *const *columns,
+                         const double *values, size_t rows, double *result)
+{
+    const struct Kernels *k;
+    struct Branch *branch;
+    struct Instruction *in;
+    double **slot, *buffer, *zero, *temporary;
+    const double **top;
+    uint32_t i, j, m, half, slots, depth, branches, open;
+    size_t row, n, r;
+    double *b;
+
+    if (p == NULL || p->length == 0) {
+        memset(result, 0, rows * sizeof(double));
+        return;
+    }
+
+    k = kernels();
+
+    /* every conditional may keep one more value on the stack */
+    branches = 0;
+
+    for (i = 0; i < p->length; i++)
+        if (p->code[i].opcode == OP_JZ)
+            branches++;
+
+    slots = p->depth + branches;
+
+    /* both branches are calculated, so every temporary is stored
+     * before it is used */
+    buffer = xcalloc((size_t) (slots + branches + 1 + p->temporaries)
+                     * BATCH_ROWS, sizeof(double));
+    slot = xcalloc(slots, sizeof(double *));
+    top = xcalloc(slots, sizeof(double *));
+    branch = xcalloc(branches ? branches : 1, sizeof(struct Branch));
+
+    for (i = 0; i < slots; i++)
+        slot[i] = buffer + (size_t) i * BATCH_ROWS;
+
+    for (i = 0; i < branches; i++)
+        branch[i].condition = buffer + (size_t) (slots + i) * BATCH_ROWS;
+
+    zero = buffer + (size_t) (slots + branches) * BATCH_ROWS;
+    temporary = zero + BATCH_ROWS;
+
+    for (row = 0; row < rows; row += BATCH_ROWS) {
+        n = (rows - row < BATCH_ROWS) ? rows - row : BATCH_ROWS;
+
+        depth = 0;
+        open = 0;
+
+        for (i = 0; i <= p->length; i++) {
+            /* close the conditionals that end here */
+            while (open > 0 && branch[open - 1].end == i) {
+                open--;
+                depth--;
+                k->select(slot[depth - 1], branch[open].condition,
+                          top[depth - 1], top[depth], n);
+                top[depth - 1] = slot[depth - 1];
+            }
+
+            if (i == p->length)
+                break;
+
+            in = p->code + i;
+
+            switch (in->opcode) {
+            case OP_PUSH:
+                b = slot[depth];
+
+                for (r = 0; r < n; r++)
+                    b[r] = p->constant_double[in->arg];
+
+                top[depth++] = b;
+                break;
+
+            case OP_LOAD:
+                /* columns are used in place, a fixed value is spread
+                 * over the block */
+                if (columns != NULL && columns[in->arg] != NULL)
+                    top[depth++] = columns[in->arg] + row;
+                else if (values != NULL) {
+                    b = slot[depth];
+
+                    for (r = 0; r < n; r++)
+                        b[r] = values[in->arg];
+
+                    top[depth++] = b;
+                } else
+                    top[depth++] = zero;
+                break;
+
+            case OP_ADD:
+                depth--;
+                k->add(slot[depth - 1], top[depth - 1], top[depth], n);
+                top[depth - 1] = slot[depth - 1];
+                break;
+
+            case OP_SUB:
+                depth--;
+                k->sub(slot[depth - 1], top[depth - 1], top[depth], n);
+                top[depth - 1] = slot[depth - 1];
+                break;
+
+            case OP_MUL:
+                depth--;
+                k->mul(slot[depth - 1], top[depth - 1], top[depth], n);
+                top[depth - 1] = slot[depth - 1];
+                break;
+
+            case OP_DIV:
+                depth--;
+                k->div(slot[depth - 1], top[depth - 1], top[depth], n);
+                top[depth - 1] = slot[depth - 1];
+                break;
+
+            case OP_POW:
+                depth--;
+                b = slot[depth - 1];
+
+                for (r = 0; r < n; r++)
+                    b[r] = pow(top[depth - 1][r], top[depth][r]);
+
+                top[depth - 1] = b;
+                break;
+
+            case OP_EXP10:
+                depth--;
+                b = slot[depth - 1];
+
+                for (r = 0; r < n; r++)
+                    b[r] = top[depth - 1][r] * pow(10.0, top[depth][r]);
+
+                top[depth - 1] = b;
+                break;
+
+            case OP_JZ:
+                /* keep the condition and go on with the true branch */
+                depth--;
+                memcpy(branch[open].condition, top[depth],
+                       n * sizeof(double));
+                branch[open].end = 0;
+                open++;
+                break;
+
+            case OP_JMP:
+                /* the true value stays, the false branch is put above */
+                branch[open - 1].end = in->arg;
+                break;
+
+            case OP_STORE:
+                memcpy(temporary + (size_t) in->arg * BATCH_ROWS,
+                       top[depth - 1], n * sizeof(double));
+                break;
+
+            case OP_FETCH:
+                top[depth++] = temporary + (size_t) in->arg * BATCH_ROWS;
+                break;
+
+            case OP_SUM:
+            case OP_PRODUCT:
+                /* pairwise like the interpreter, the upper half of the
+                 * columns with the lower half until one is left */
+                depth -= in->arg - 1;
+
+                for (m = in->arg; m > 1; m = half) {
+                    half = (m + 1) / 2;
+
+                    for (j = depth - 1; j + half < depth - 1 + m; j++) {
+                        if (in->opcode == OP_SUM)
+                            k->add(slot[j], top[j], top[j + half], n);
+                        else
+                            k->mul(slot[j], top[j], top[j + half], n);
+
+                        top[j] = slot[j];
+                    }
+                }
+                break;
+            }
+        }
+
+        memcpy(result + row, top[0], n * sizeof(double));
+    }
+
+    free(branch);
+    free(top);
+    free(slot);
+    free(buffer);
+}
+
+/* returns the first variable of a program without a column
+ * and without a fixed value (or 0) */
+char missing_column(struct Program *p, struct Table *t, struct Bindings *b)
+{
+    uint32_t i;
+    char name;
+
+    for (i = 0; i < p->length; i++) {
+        if (p->code[i].opcode != OP_LOAD || t->column[p->code[i].arg] != NULL)
+            continue;
+
+        name = (char) ('a' + p->code[i].arg);
+
+        if (!IS_BOUND(b, name))
+            return (name);
+    }
+
+    return (0);
+}
+
+/* reads a table of values
+ * the first line names the variables of the columns (e.g. "a b x"),
+ * every further line holds one row of numbers
+ * 1. argument: name of the file
+ * return value: pointer of the table or NULL */
+struct Table *read_table(const char *filename)
+{
+    struct Table *t;
+    FILE *file;
+    char *line, *s, *end;
+    size_t size;
+    int order[VARIABLES], columns, c, i;
+    double value;
+
+    if ((file = fopen(filename, "r")) == NULL) {
+        perror("fopen");
+        return (NULL);
+    }
+
+    line = NULL;
+    size = 0;
+
+    if (getline(&line, &size, file) == -1) {
+        fprintf(stderr, "%s: missing header\n", filename);
+        fclose(file);
+        return (NULL);
+    }
+
+    t = xcalloc(1, sizeof(struct Table));
+    t->size = 1024;
+    columns = 0;
+
+    for (s = line; *s != '\0'; s++) {
+        if (isspace((unsigned char) *s))
+            continue;
+
+        if (!islower((unsigned char) *s) || columns == VARIABLES
+            || t->column[*s - 'a'] != NULL) {
+            fprintf(stderr, "%s: bad header near '%c'\n", filename, *s);
+            free(line);
+            fclose(file);
+            delete_table(t);
+            return (NULL);
+        }
+
+        order[columns++] = *s - 'a';
+        t->column[*s - 'a'] = xcalloc(t->size, sizeof(double));
+    }
+
+    while (getline(&line, &size, file) != -1) {
+        s = line;
+
+        while (isspace((unsigned char) *s))
+            s++;
+
+        /* empty line */
+        if (*s == '\0')
+            continue;
+
+        if (t->rows == t->size) {
+            t->size *= 2;
+
+            for (i = 0; i < columns; i++) {
+                c = order[i];
+
+                if ((t->column[c] = realloc(t->column[c],
+                                            t->size * sizeof(double)))
+                    == NULL) {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+            }
+        }
+
+        for (i = 0; i < columns; i++) {
+            value = strtod(s, &end);
+
+            if (end == s) {
+                fprintf(stderr, "%s: bad value in row %lu\n", filename,
+                        (unsigned long) t->rows + 1);
+                free(line);
+                fclose(file);
+                delete_table(t);
+                return (NULL);
+            }
+
+            t->column[order[i]][t->rows] = value;
+            s = end;
+        }
+
+        t->rows++;
+    }
+
+    free(line);
+    fclose(file);
+
+    return (t);
+}
+
+void delete_table(struct Table *t)
+{
+    int i;
+
+    if (t == NULL)
+        return;
+
+    for (i = 0; i < VARIABLES; i++)
+        free(t->column[i]);
+
+    free(t);
+}
@@ -0,0 +1,49 @@
+/*
+    fp - batch.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_BATCH_H
+#define FP_BATCH_H
+
+#include <stddef.h>
+
+#include "program.h"
+
+struct Bindings;
+
+/* number of rows that are calculated together */
+#define BATCH_ROWS 256
+
+/* values of the variables stored as columns,
+ * column[v] is NULL if variable 'a' + v is not in the table */
+struct Table {
+    double *column[VARIABLES];
+    size_t rows;
+    size_t size;
+};
+
+extern const char *batch_kernels(void);
+extern void run_program_columns(struct Program *, double *const *,
+                                const double *, size_t, double *);
+extern struct Table *read_table(const char *);
+extern void delete_table(struct Table *);
+extern char missing_column(struct Program *, struct Table *,
+                           struct Bindings *);
+
+#endif
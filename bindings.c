@@ -0,0 +1,166 @@
+/*
+    fp - bindings.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "node.h"
+#include "grammar.h"
+#include "formula.h"
+#include "program.h"
+#include "bindings.h"
+
+struct Bindings *new_bindings(void)
+{
+    struct Bindings *b;
+
+    if ((b = calloc(1, sizeof(struct Bindings))) == NULL) {
+        perror("calloc(bindings)");
+        exit(EXIT_FAILURE);
+    }
+
+    return (b);
+}
+
+void delete_bindings(struct Bindings *b)
+{
+    free(b);
+}
+
+/* binds a variable to a value
+ * 1. argument: pointer of the bindings
+ * 2. argument: string like "a=1.5", the value can be any formula
+ *              without variables
+ * return value: 0 on success, -1 on error */
+int bind_variable(struct Bindings *b, const char *binding)
+{
+    struct Node *value;
+    char *formula;
+    size_t length;
+    char name;
+
+    while (isspace((unsigned char) *binding))
+        binding++;
+
+    name = *binding++;
+
+    while (isspace((unsigned char) *binding))
+        binding++;
+
+    if (!islower((unsigned char) name) || *binding != '=') {
+        fprintf(stderr, "expecting VARIABLE=VALUE\n");
+        return (-1);
+    }
+
+    binding++;
+
+    while (isspace((unsigned char) *binding))
+        binding++;
+
+    if ((formula = strdup(binding)) == NULL) {
+        perror("strdup");
+        exit(EXIT_FAILURE);
+    }
+
+    /* remove trailing spaces and newline */
+    length = strlen(formula);
+
+    while (length > 0 && isspace((unsigned char) formula[length - 1]))
+        formula[--length] = '\0';
+
+    /* parse the value once */
+    if ((value = parse(formula)) == NULL) {
+        fprintf(stderr, "cannot create parse tree for value of %c\n", name);
+        free(formula);
+        return (-1);
+    }
+
+    reduce(value);
+
+    if (value->type != NUMBER) {
+        fprintf(stderr, "value of %c must be a number\n", name);
+        delete_tree(value);
+        free(formula);
+        return (-1);
+    }
+
+    b->value[name - 'a'] = value->data.value;
+    b->bound |= 1UL << (name - 'a');
+
+    delete_tree(value);
+    free(formula);
+
+    return (0);
+}
+
+/* reads bindings from a file, one "VARIABLE=VALUE" per line,
+ * empty lines and lines starting with '#' are skipped
+ * 1. argument: pointer of the bindings
+ * 2. argument: name of the file
+ * return value: 0 on success, -1 on error */
+int read_bindings(struct Bindings *b, const char *filename)
+{
+    FILE *file;
+    char *line, *s;
+    size_t size;
+    int ret;
+
+    if ((file = fopen(filename, "r")) == NULL) {
+        perror("fopen");
+        return (-1);
+    }
+
+    line = NULL;
+    size = 0;
+    ret = 0;
+
+    while (ret == 0 && getline(&line, &size, file) != -1) {
+        for (s = line; isspace((unsigned char) *s); s++);
+
+        if (*s == '\0' || *s == '#')
+            continue;
+
+        ret = bind_variable(b, s);
+    }
+
+    free(line);
+    fclose(file);
+
+    return (ret);
+}
+
+/* searches the variables a program loads for one without a value,
+ * in the order they are written in the formula
+ * 1. argument: pointer of the program
+ * 2. argument: fixed values of variables
+ * return value: name of the first such variable or 0 if there is none */
+char missing_value(struct Program *p, struct Bindings *b)
+{
+    uint32_t i;
+
+    for (i = 0; i < p->length; i++)
+        if (p->code[i].opcode == OP_LOAD
+            && !IS_BOUND(b, 'a' + (int) p->code[i].arg))
+            return ((char) ('a' + p->code[i].arg));
+
+    return (0);
+}
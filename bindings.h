@@ -0,0 +1,43 @@
+/*
+    fp - bindings.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_BINDINGS_H
+#define FP_BINDINGS_H
+
+#include "node.h"
+#include "program.h"
+
+/* fixed values of variables, bit v of bound is set if
+ * variable 'a' + v has a value */
+struct Bindings {
+    number value[VARIABLES];
+    unsigned long bound;
+};
+
+#define IS_BOUND(b, name) \
+    ((b) != NULL && ((b)->bound & (1UL << ((name) - 'a'))))
+
+extern struct Bindings *new_bindings(void);
+extern void delete_bindings(struct Bindings *);
+extern int bind_variable(struct Bindings *, const char *);
+extern int read_bindings(struct Bindings *, const char *);
+extern char missing_value(struct Program *, struct Bindings *);
+
+#endif
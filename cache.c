@@ -0,0 +1,328 @@
+/*
+    fp - cache.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+/* ',' and '.' are the same decimal point */
+#define NORMAL(c) ((c) == ',' ? '.' : (c))
+
+/* the first character of a formula is never skipped,
+ * a leading space is a syntax error */
+#define SKIPPED(term, i) ((i) > 0 && (term)[i] == ' ')
+
+static void check(int error, const char *function)
+{
+    if (error != 0) {
+        errno = error;
+        perror(function);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* hashes the text of a formula like it is written in the key (FNV-1a)
+ * 1. argument: string of the formula (needs no '\0')
+ * 2. argument: length of the string
+ * return value: the hash */
+static unsigned long hash_formula(const char *term, size_t length)
+{
+    unsigned long hash;
+    size_t i;
+
+    hash = 2166136261UL;
+
+    for (i = 0; i < length; i++) {
+        if (SKIPPED(term, i))
+            continue;
+
+        hash ^= (unsigned char) NORMAL(term[i]);
+        hash *= 16777619UL;
+    }
+
+    return (hash);
+}
+
+/* compares the key of an entry with the text of a formula
+ * 1. argument: pointer of the entry
+ * 2. argument: string of the formula (needs no '\0')
+ * 3. argument: length of the string
+ * return value: 1 if the formula has this key, 0 if not */
+static int same_formula(struct CacheEntry *e, const char *term,
+                        size_t length)
+{
+    size_t i, k;
+
+    for (i = 0, k = 0; i < length; i++) {
+        if (SKIPPED(term, i))
+            continue;
+
+        if (k == e->length || e->key[k] != NORMAL(term[i]))
+            return (0);
+
+        k++;
+    }
+
+    return (k == e->length);
+}
+
+static void delete_entry(struct CacheEntry *e)
+{
+    delete_jit(e->jit);
+    delete_program(e->program);
+    free(e->key);
+    free(e);
+}
+
+/* takes an entry out of the list of recently used formulas
+ * 1. argument: pointer of the cache
+ * 2. argument: pointer of the entry
+ * return value: none */
+static void unlink_entry(struct Cache *c, struct CacheEntry *e)
+{
+    if (e->newer != NULL)
+        e->newer->older = e->older;
+    else
+        c->newest = e->older;
+
+    if (e->older != NULL)
+        e->older->newer = e->newer;
+    else
+        c->oldest = e->newer;
+
+    e->newer = e->older = NULL;
+}
+
+/* puts an entry in front of the list of recently used formulas
+ * 1. argument: pointer of the cache
+ * 2. argument: pointer of the entry
+ * return value: none */
+static void use_entry(struct Cache *c, struct CacheEntry *e)
+{
+    e->older = c->newest;
+    e->newer = NULL;
+
+    if (c->newest != NULL)
+        c->newest->newer = e;
+    else
+        c->oldest = e;
+
+    c->newest = e;
+}
+
+/* removes the least recently used formula, it is deleted
+ * when nobody uses it anymore
+ * 1. argument: pointer of the cache
+ * return value: none */
+static void evict(struct Cache *c)
+{
+    struct CacheEntry *e, **p;
+
+    e = c->oldest;
+    unlink_entry(c, e);
+
+    for (p = &c->bucket[e->hash & (c->buckets - 1)]; *p != e;
+         p = &(*p)->next);
+
+    *p = e->next;
+    e->stored = 0;
+    c->entries--;
+    c->evictions++;
+
+    if (e->refs == 0)
+        delete_entry(e);
+}
+
+/* searches an entry under the lock of the cache
+ * 1. argument: pointer of the cache
+ * 2. argument: string of the formula (needs no '\0')
+ * 3. argument: length of the string
+ * 4. argument: hash of the formula
+ * return value: pointer of the entry or NULL */
+static struct CacheEntry *lookup(struct Cache *c, const char *term,
+                                 size_t length, unsigned long hash)
+{
+    struct CacheEntry *e;
+
+    for (e = c->bucket[hash & (c->buckets - 1)]; e != NULL; e = e->next)
+        if (e->hash == hash && same_formula(e, term, length))
+            return (e);
+
+    return (NULL);
+}
+
+/* creates a cache of compiled formulas
+ * 1. argument: maximal number of formulas (0: nothing is kept)
+ * return value: pointer of the cache */
+struct Cache *new_cache(size_t size)
+{
+    struct Cache *c;
+
+    if ((c = calloc(1, sizeof(struct Cache))) == NULL) {
+        perror("calloc(cache)");
+        exit(EXIT_FAILURE);
+    }
+
+    /* at most every second bucket is used */
+    for (c->buckets = 1; c->buckets < 2 * size; c->buckets *= 2);
+
+    if ((c->bucket = calloc(c->buckets, sizeof(struct CacheEntry *)))
+        == NULL) {
+        perror("calloc(cache)");
+        exit(EXIT_FAILURE);
+    }
+
+    c->size = size;
+    check(pthread_mutex_init(&c->lock, NULL), "pthread_mutex_init");
+
+    return (c);
+}
+
+/* searches the compiled form of a formula, it has to be released
+ * after the calculation
+ * 1. argument: pointer of the cache
+ * 2. argument: string of the formula (needs no '\0')
+ * 3. argument: length of the string
+ * return value: pointer of the entry or NULL if it is not cached */
+struct CacheEntry *find_formula(struct Cache *c, const char *term,
+                                size_t length)
+{
+    struct CacheEntry *e;
+    unsigned long hash;
+
+    hash = hash_formula(term, length);
+
+    check(pthread_mutex_lock(&c->lock), "pthread_mutex_lock");
+
+    if ((e = lookup(c, term, length, hash)) != NULL) {
+        unlink_entry(c, e);
+        use_entry(c, e);
+        e->refs++;
+        c->hits++;
+    } else
+        c->misses++;
+
+    check(pthread_mutex_unlock(&c->lock), "pthread_mutex_unlock");
+
+    return (e);
+}
+
+/* keeps the compiled form of a formula, the least recently used
+ * formula is removed if the cache is full
+ * 1. argument: pointer of the cache
+ * 2. argument: string of the formula (needs no '\0')
+ * 3. argument: length of the string
+ * 4. argument: the program of the formula (owned by the cache now)
+ * 5. argument: native code of the program or NULL (owned by the cache)
+ * return value: pointer of the entry, it has to be released
+ *               after the calculation */
+struct CacheEntry *add_formula(struct Cache *c, const char *term,
+                               size_t length, struct Program *program,
+                               struct Jit *jit)
+{
+    struct CacheEntry *e, *old;
+    size_t i;
+
+    if ((e = calloc(1, sizeof(struct CacheEntry))) == NULL
+        || (e->key = malloc(length + 1)) == NULL) {
+        perror("malloc(cache)");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < length; i++)
+        if (!SKIPPED(term, i))
+            e->key[e->length++] = NORMAL(term[i]);
+
+    e->key[e->length] = '\0';
+    e->hash = hash_formula(term, length);
+    e->program = program;
+    e->jit = jit;
+    e->refs = 1;
+
+    if (c->size == 0)
+        return (e);
+
+    check(pthread_mutex_lock(&c->lock), "pthread_mutex_lock");
+
+    /* another thread compiled the formula meanwhile */
+    if ((old = lookup(c, term, length, e->hash)) != NULL) {
+        old->refs++;
+        check(pthread_mutex_unlock(&c->lock), "pthread_mutex_unlock");
+        delete_entry(e);
+        return (old);
+    }
+
+    if (c->entries == c->size)
+        evict(c);
+
+    e->next = c->bucket[e->hash & (c->buckets - 1)];
+    c->bucket[e->hash & (c->buckets - 1)] = e;
+    e->stored = 1;
+    use_entry(c, e);
+    c->entries++;
+
+    check(pthread_mutex_unlock(&c->lock), "pthread_mutex_unlock");
+
+    return (e);
+}
+
+/* ends the use of an entry
+ * 1. argument: pointer of the cache
+ * 2. argument: pointer of the entry
+ * return value: none */
+void release_formula(struct Cache *c, struct CacheEntry *e)
+{
+    int unused;
+
+    check(pthread_mutex_lock(&c->lock), "pthread_mutex_lock");
+    unused = (--e->refs == 0 && !e->stored);
+    check(pthread_mutex_unlock(&c->lock), "pthread_mutex_unlock");
+
+    if (unused)
+        delete_entry(e);
+}
+
+void print_cache_statistics(struct Cache *c, FILE *f)
+{
+    fprintf(f, "cache: %lu hits, %lu misses, %lu evictions, "
+            "%lu of %lu formulas kept\n", c->hits, c->misses,
+            c->evictions, (unsigned long) c->entries,
+            (unsigned long) c->size);
+}
+
+void delete_cache(struct Cache *c)
+{
+    struct CacheEntry *e, *older;
+
+    if (c == NULL)
+        return;
+
+    for (e = c->newest; e != NULL; e = older) {
+        older = e->older;
+        delete_entry(e);
+    }
+
+    pthread_mutex_destroy(&c->lock);
+    free(c->bucket);
+    free(c);
+}
@@ -0,0 +1,70 @@
+/*
+    fp - cache.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_CACHE_H
+#define FP_CACHE_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+#include "program.h"
+#include "jit.h"
+
+/* default number of compiled formulas that are kept */
+#define CACHE_SIZE 1024
+
+/* a compiled formula, the key is the text of the formula without
+ * spaces and with '.' as decimal point */
+struct CacheEntry {
+    char *key;
+    size_t length;
+    unsigned long hash;
+    struct Program *program;
+    struct Jit *jit;            /* NULL without native code */
+    int refs;                   /* users of the entry */
+    char stored;                /* the entry is in the cache */
+    struct CacheEntry *next;    /* next entry of the bucket */
+    struct CacheEntry *newer;
+    struct CacheEntry *older;
+};
+
+/* the least recently used formula is removed first */
+struct Cache {
+    struct CacheEntry **bucket;
+    size_t buckets;
+    size_t entries;
+    size_t size;
+    struct CacheEntry *newest;
+    struct CacheEntry *oldest;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    pthread_mutex_t lock;
+};
+
+extern struct Cache *new_cache(size_t);
+extern struct CacheEntry *find_formula(struct Cache *, const char *, size_t);
+extern struct CacheEntry *add_formula(struct Cache *, const char *, size_t,
+                                      struct Program *, struct Jit *);
+extern void release_formula(struct Cache *, struct CacheEntry *);
+extern void print_cache_statistics(struct Cache *, FILE *);
+extern void delete_cache(struct Cache *);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+    fp - check_parts.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "node.h"
+#include "grammar.h"
+#include "formula.h"
+#include "program.h"
+#include "parallel.h"
+
+/* operands of the chain "a/1+b/2+c/3+..." */
+#define OPERANDS 100000
+
+/* threads the chain is split for */
+#define THREADS 4
+
+/* checks that a large chain is split into several parts and that the
+ * parts give the value the program has on one thread */
+int main(void)
+{
+    struct Node *tree;
+    struct Program *program;
+    number vars[VARIABLES], serial, parallel;
+    char *formula, *s;
+    int i;
+
+    if ((formula = malloc(OPERANDS * 16)) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0, s = formula; i < OPERANDS; i++)
+        s += sprintf(s, "%s%c/%d", (i > 0) ? "+" : "", 'a' + i % 3, i + 1);
+
+    for (i = 0; i < VARIABLES; i++)
+        vars[i] = (number) (i + 1) / 3;
+
+    set_task_threads(THREADS);
+
+    if ((tree = parse_report(formula, strlen(formula), stderr)) == NULL)
+        exit(EXIT_FAILURE);
+
+    reduce(tree);
+    program = compile_tree(tree);
+
+    if (program->parts < 2) {
+        printf("check: the chain has %u parts\n", program->parts);
+        exit(EXIT_FAILURE);
+    }
+
+    parallel = run_program(program, vars);
+    set_task_threads(1);
+    serial = run_program(program, vars);
+
+    if (parallel != serial) {
+        printf("check: the %u parts of the chain change its value\n",
+               program->parts);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("check: %u parts of a chain of %d operands\n", program->parts,
+           OPERANDS);
+
+    delete_program(program);
+    delete_tree(tree);
+    free(formula);
+
+    return (0);
+}
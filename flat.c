@@ -0,0 +1,459 @@
+/*
+    fp - flat.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "node.h"
+#include "list.h"
+#include "flat.h"
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p;
+
+    if (n == 0)
+        return (NULL);
+
+    if ((p = calloc(n, size)) == NULL) {
+        perror("calloc(flat tree)");
+        exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+/* the shared nodes that are stored already, open addressing,
+ * the nodes of a branch are removed at its end in the reverse order
+ * they were added, so no other entry has to move */
+struct Seen {
+    struct Node **node;
+    uint32_t *index;
+    size_t size;
+    size_t *added;              /* slots in the order they were used */
+    size_t count;
+};
+
+/* counts the nodes of a tree and the entries of the cold arrays
+ * (a shared subtree is counted for every use) */
+static void count_nodes(struct Node *root, struct FlatTree *t)
+{
+    struct List stack;
+    struct Node *child;
+    int i;
+
+    if (root == NULL)
+        return;
+
+    /* the order of counting does not matter */
+    init_list(&stack);
+    add_node(&stack, root);
+
+    while (stack.count > 0) {
+        root = stack.node[--stack.count];
+
+        t->count++;
+
+        if (root->shared)
+            t->shared++;
+
+        if (root->type == NUMBER)
+            t->values++;
+
+        if (root->type == CONDITIONAL)
+            t->conditionals++;
+
+        /* enough for the operand lists of the chains (see chain_kind) */
+        if (IS_CHAIN(root))
+            t->operands += 3;
+
+        for (i = 0; (child = child_node(root, i)) != NULL; i++)
+            add_node(&stack, child);
+    }
+
+    free_list(&stack);
+}
+
+static size_t seen_slot(struct Seen *s, struct Node *n)
+{
+    size_t i;
+
+    i = ((uintptr_t) n / sizeof(struct Node)) & (s->size - 1);
+
+    while (s->node[i] != NULL && s->node[i] != n)
+        i = (i + 1) & (s->size - 1);
+
+    return (i);
+}
+
+/* removes the shared nodes that were stored after a mark */
+static void forget(struct Seen *s, size_t mark)
+{
+    while (s->count > mark)
+        s->node[s->added[--s->count]] = NULL;
+}
+
+/* collects the operands of a chain like "a+b+c" for add_nodes(), they
+ * are taken from the end of the list from left to right until the NULL
+ * before them, a shared node inside the chain is walked through like
+ * the others, so the values are combined in the same order as without
+ * sharing (its other uses still refer to one value)
+ * 1. argument: pointer of the chain
+ * 2. argument: list that receives the operands
+ * return value: none */
+static void add_operands(struct Node *root, struct List *todo)
+{
+    struct List chain;
+    struct Node *n;
+
+    init_list(&chain);
+    add_node(&chain, root);
+    add_node(todo, NULL);
+
+    /* the right side comes first */
+    while (chain.count > 0) {
+        n = chain.node[--chain.count];
+
+        if (n == root || IN_CHAIN(n, root->data.op.operator)) {
+            add_node(&chain, n->data.op.left);
+            add_node(&chain, n->data.op.right);
+        } else
+            add_node(todo, n);
+    }
+
+    free_list(&chain);
+}
+
+/* the kind and the left entry of a node that combines values of a chain,
+ * a SUM or PRODUCT gets the list of its operands
+ * 1. argument: pointer of the flat tree
+ * 2. argument: the operator of the chain
+ * 3. argument: indices of the values
+ * 4. argument: number of values (at least 2)
+ * 5. argument: pointer that receives the left entry
+ * return value: the kind */
+static unsigned char chain_kind(struct FlatTree *t, int operator,
+                                const size_t *index, size_t n,
+                                uint32_t *left)
+{
+    size_t k;
+
+    /* two values need no list */
+    if (n == 2) {
+        *left = (uint32_t) index[0];
+        return ((unsigned char) operator);
+    }
+
+    *left = t->operands;
+    t->operand[t->operands++] = (uint32_t) n;
+
+    for (k = 0; k < n; k++)
+        t->operand[t->operands++] = (uint32_t) index[k];
+
+    return (operator == ADD ? SUM : PRODUCT);
+}
+
+/* combines the values of a chain in groups of CHAIN_GROUP after an
+ * operand was appended, the groups are counted like the digits of the
+ * number of operands, so at most CHAIN_GROUP - 1 values of every digit
+ * are waiting
+ * 1. argument: pointer of the flat tree
+ * 2. argument: the operator of the chain
+ * 3. argument: indices of the appended subtrees
+ * 4. argument: number of indices
+ * 5. argument: number of operands appended so far (at least 1)
+ * return value: the new number of indices */
+static size_t group_operands(struct FlatTree *t, int operator, size_t *done,
+                             size_t count, unsigned long operands)
+{
+    uint32_t i, left;
+    unsigned char kind;
+
+    for (; operands % CHAIN_GROUP == 0; operands /= CHAIN_GROUP) {
+        count -= CHAIN_GROUP;
+        kind = chain_kind(t, operator, done + count, CHAIN_GROUP, &left);
+
+        i = t->count++;
+        t->kind[i] = kind;
+        t->left[i] = left;
+        done[count++] = i;
+    }
+
+    return (count);
+}
+
+/* combines values pairwise, the upper half is added to or multiplied
+ * with the lower half until one value is left (like OP_SUM and
+ * OP_PRODUCT)
+ * 1. argument: the values, they are overwritten
+ * 2. argument: number of values (at least 1)
+ * 3. argument: ADD or MULTIPLY
+ * return value: the result */
+static number combine_values(number *x, size_t n, int operator)
+{
+    size_t i, half;
+
+    for (; n > 1; n = half) {
+        half = (n + 1) / 2;
+
+        if (operator == ADD)
+            for (i = 0; i + half < n; i++)
+                x[i] += x[i + half];
+        else
+            for (i = 0; i + half < n; i++)
+                x[i] *= x[i + half];
+    }
+
+    return (x[0]);
+}
+
+/* combines the values of a chain in the order of its compiled program,
+ * the groups of CHAIN_GROUP values first (see group_operands) and then
+ * the rest, so a folded chain has the value it has at run time
+ * 1. argument: the values in the order of the chain, they are overwritten
+ * 2. argument: number of values (at least 1)
+ * 3. argument: ADD or MULTIPLY
+ * return value: the result */
+number combine_chain(number *x, size_t n, int operator)
+{
+    size_t k, count, operands;
+
+    for (k = count = 0; k < n; k++) {
+        for (operands = k; operands > 0 && operands % CHAIN_GROUP == 0;
+             operands /= CHAIN_GROUP) {
+            count -= CHAIN_GROUP;
+            x[count] = combine_values(x + count, CHAIN_GROUP, operator);
+            count++;
+        }
+
+        x[count++] = x[k];
+    }
+
+    return (combine_values(x, count, operator));
+}
+
+/* appends a tree in post-order
+ * 1. argument: pointer of the tree
+ * 2. argument: pointer of the flat tree
+ * 3. argument: the shared nodes that are stored already
+ * 4. argument: array for the indices of the subtrees that were appended
+ *              and the marks of the conditionals (count + conditionals)
+ * return value: none */
+static void add_nodes(struct Node *root, struct FlatTree *t,
+                      struct Seen *s, size_t *done)
+{
+    struct Walk w;
+    struct Step *step;
+    struct List todo;
+    struct Node *child;
+    uint32_t i, left;
+    unsigned long x;
+    size_t slot, count, n;
+    unsigned char kind;
+
+    init_walk(&w);
+    enter_node(&w, root);
+    init_list(&todo);
+    count = 0;
+
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
+
+        if (step->state == 0 && root->shared) {
+            slot = seen_slot(s, root);
+
+            /* the value is calculated already */
+            if (s->node[slot] != NULL) {
+                i = t->count++;
+                t->kind[i] = REFERENCE;
+                t->left[i] = s->index[slot];
+                done[count++] = i;
+                w.count--;
+                continue;
+            }
+        }
+
+        left = 0;
+
+        if (root->type == OPERATOR)
+            kind = (unsigned char) root->data.op.operator;
+        else
+            kind = (unsigned char) root->type;
+
+        switch (root->type) {
+        case NUMBER:
+            left = t->values;
+            t->value[t->values++] = root->data.value;
+            break;
+
+        case VARIABLE:
+            left = (uint32_t) VARIABLE_SLOT(root);
+            break;
+
+        case OPERATOR:
+            if (IS_CHAIN(root)) {
+                /* state is the number of operands appended so far */
+                if (step->state == 0)
+                    add_operands(root, &todo);
+                else if (todo.node[todo.count - 1] != NULL)
+                    count = group_operands(t, root->data.op.operator, done,
+                                           count, step->state);
+
+                if ((child = todo.node[--todo.count]) != NULL) {
+                    step->state++;
+                    enter_node(&w, child);
+                    continue;
+                }
+
+                /* the groups before the last operand and the last one */
+                n = 1;
+
+                for (x = step->state - 1; x > 0; x /= CHAIN_GROUP)
+                    n += x % CHAIN_GROUP;
+
+                count -= n;
+                kind = chain_kind(t, root->data.op.operator, done + count,
+                                  n, &left);
+                break;
+            }
+
+            if (step->state < 2) {
+                enter_node(&w, child_node(root, step->state++));
+                continue;
+            }
+
+            /* the right child is node i - 1 */
+            count -= 2;
+            left = (uint32_t) done[count];
+            break;
+
+        case CONDITIONAL:
+            /* the condition is always calculated, a branch only
+             * sometimes, done holds condition, mark, true and false */
+            if (step->state == 0) {
+                step->state = 1;
+                enter_node(&w, root->data.con.condition);
+                continue;
+            }
+
+            if (step->state == 1) {
+                done[count++] = s->count;
+                step->state = 2;
+                enter_node(&w, root->data.con.true);
+                continue;
+            }
+
+            if (step->state == 2) {
+                forget(s, done[count - 2]);
+                step->state = 3;
+                enter_node(&w, root->data.con.false);
+                continue;
+            }
+
+            count -= 4;
+            forget(s, done[count + 1]);
+
+            left = t->conditionals;
+            t->con[t->conditionals].condition = (uint32_t) done[count];
+            t->con[t->conditionals].true = (uint32_t) done[count + 2];
+            t->conditionals++;
+            break;
+        }
+
+        i = t->count++;
+        t->kind[i] = kind;
+        t->left[i] = left;
+
+        /* the children may have used the slot */
+        if (root->shared) {
+            slot = seen_slot(s, root);
+            s->node[slot] = root;
+            s->index[slot] = i;
+            s->added[s->count++] = slot;
+        }
+
+        done[count++] = i;
+        w.count--;
+    }
+
+    free_list(&todo);
+    free_walk(&w);
+}
+
+/* creates a flat copy of a tree
+ * 1. argument: pointer of the tree
+ * return value: pointer of the flat tree */
+struct FlatTree *flatten(struct Node *root)
+{
+    struct FlatTree *t;
+    struct Seen s;
+    size_t *done;
+
+    if (root == NULL)
+        return (NULL);
+
+    t = xcalloc(1, sizeof(struct FlatTree));
+
+    count_nodes(root, t);
+
+    /* at most every second slot is used */
+    for (s.size = 1; s.size < 2 * (size_t) t->shared; s.size *= 2);
+
+    if (t->shared == 0)
+        s.size = 0;
+
+    s.node = xcalloc(s.size, sizeof(struct Node *));
+    s.index = xcalloc(s.size, sizeof(uint32_t));
+    s.added = xcalloc(t->shared, sizeof(size_t));
+    s.count = 0;
+
+    t->kind = xcalloc(t->count, sizeof(unsigned char));
+    t->left = xcalloc(t->count, sizeof(uint32_t));
+    t->value = xcalloc(t->values, sizeof(number));
+    t->con = xcalloc(t->conditionals, sizeof(struct FlatConditional));
+    t->operand = xcalloc(t->operands, sizeof(uint32_t));
+    done = xcalloc((size_t) t->count + t->conditionals, sizeof(size_t));
+
+    t->count = t->values = t->conditionals = 0;
+    t->operands = 0;
+
+    add_nodes(root, t, &s, done);
+
+    free(done);
+    free(s.added);
+    free(s.index);
+    free(s.node);
+
+    return (t);
+}
+
+void delete_flat_tree(struct FlatTree *t)
+{
+    if (t == NULL)
+        return;
+
+    free(t->operand);
+    free(t->con);
+    free(t->value);
+    free(t->left);
+    free(t->kind);
+    free(t);
+}
@@ -0,0 +1,93 @@
+/*
+    fp - flat.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_FLAT_H
+#define FP_FLAT_H
+
+#include <stdint.h>
+
+#include "node.h"
+
+/* kind of a node that has the value of an earlier node */
+#define REFERENCE 11
+
+/* kinds of a node with the sum or product of several operands,
+ * a chain like "a+b+c+d" is stored as one node */
+#define SUM     12
+#define PRODUCT 13
+
+/* a chain of "+" or "*" becomes one SUM or PRODUCT node */
+#define IS_CHAIN(node) (IN_CHAIN(node, ADD) || IN_CHAIN(node, MULTIPLY))
+
+/* operands of a chain that are combined at once, the operands of a
+ * longer chain are combined in groups so few values wait at a time */
+#define CHAIN_GROUP 64
+
+/* A parse tree stored in post-order in a contiguous pool.
+ * Children always come before their parent and the root is the last node,
+ * so the last child of node i is always node i - 1.
+ *
+ * A shared subtree (see share_tree) is stored once, where it is used
+ * again a REFERENCE node stands for it.
+ *
+ * hot arrays (one entry per node):
+ *   kind   NUMBER, VARIABLE, CONDITIONAL, REFERENCE, SUM, PRODUCT or
+ *          the operator (ADD ... E_SYMBOL)
+ *   left   operators:   index of the left child (right child is i - 1)
+ *          NUMBER:      index into value
+ *          VARIABLE:    slot of the variable (0 for a)
+ *          CONDITIONAL: index into con (false branch is i - 1)
+ *          REFERENCE:   index of the node with the value, it is always
+ *                       calculated before (never in another branch)
+ *          SUM, PRODUCT: index into operand (last operand is i - 1)
+ *
+ * cold arrays:
+ *   value     numbers of the NUMBER nodes
+ *   con       condition and true branch of the CONDITIONAL nodes
+ *   operand   number of operands of a SUM or PRODUCT node followed by
+ *             their indices (in the order of the chain) */
+
+struct FlatConditional {
+    uint32_t condition;
+    uint32_t true;
+};
+
+struct FlatTree {
+    uint32_t count;
+    uint32_t shared;            /* uses of shared nodes */
+
+    unsigned char *kind;
+    uint32_t *left;
+
+    number *value;
+    uint32_t values;
+
+    struct FlatConditional *con;
+    uint32_t conditionals;
+
+    uint32_t *operand;
+    uint32_t operands;
+};
+
+extern struct FlatTree *flatten(struct Node *);
+extern void delete_flat_tree(struct FlatTree *);
+extern number combine_chain(number *, size_t, int);
+
+#endif
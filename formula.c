@@ -28,207 +28,629 @@
 
 #include "node.h"
 #include "list.h"
+#include "flat.h"
 #include "grammar.h"
+#include "bindings.h"
+#include "parallel.h"
+
+/* number of values calculate_parse_tree() keeps without allocating
+ * memory */
+#define VALUES_INLINE 64
+
+/* subtrees of a tree that are calculated on their own, in the order
+ * they are met when the tree is calculated */
+struct Parts {
+    struct List node;
+    number *value;
+    const number *vars;
+};
+
+/* the values of the subtrees that are calculated already, the last
+ * value belongs to the subtree that was left last */
+struct Values {
+    number *value;
+    size_t count;
+    size_t size;
+    number small[VALUES_INLINE];
+};
+
+static void push_value(struct Values *v, number value)
+{
+    number *values;
 
-/* calculates the value of a parse tree
- * 1. argument: pointer of the parse tree
- * return value: the value of the parse tree */
-long double calculate_parse_tree(struct Node *root)
+    /* the array is doubled when it is full */
+    if (v->count == v->size) {
+        if ((values = malloc(2 * v->size * sizeof(number))) == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(values, v->value, v->count * sizeof(number));
+
+        if (v->value != v->small)
+            free(v->value);
+
+        v->value = values;
+        v->size *= 2;
+    }
+
+    v->value[v->count++] = value;
+}
+
+/* applies an operator to two values
+ * 1. argument: the operator
+ * 2. argument: the left value
+ * 3. argument: the right value
+ * return value: the result */
+static number calculate_operator(int operator, number left, number right)
 {
-    long double left, right;
+    switch (operator) {
+    case ADD:
+        return (left + right);
 
-    switch (root->type) {
-    case NUMBER:
-        return (root->data.value);
-        break;
+    case MINUS:
+        return (left - right);
 
-    case OPERATOR:
-        left = calculate_parse_tree(root->data.op.left);
-        right = calculate_parse_tree(root->data.op.right);
+    case MULTIPLY:
+        return (left * right);
 
-        switch (root->data.op.operator) {
-        case ADD:
-            return (left + right);
-            break;
+    case DIVIDE:
+        return (left / right);
 
-        case MINUS:
-            return (left - right);
+    case POWER:
+        return (number_pow(left, right));
+
+    case E_SYMBOL:
+        return (left * number_pow(10, right));
+    }
+
+    return (0);
+}
+
+/* calculates the value of a parse tree, the values of its parts are
+ * used instead of calculating them again, a chain like "a+b+c" is
+ * combined like in the compiled program (see combine_chain)
+ * 1. argument: pointer of the parse tree
+ * 2. argument: values of the variables a-z (NULL: all variables are 0)
+ * 3. argument: parts that are calculated already (NULL: none)
+ * return value: the value of the parse tree */
+static number calculate_tree(struct Node *root, const number *vars,
+                             struct Parts *p)
+{
+    struct Walk w;
+    struct Step *step;
+    struct Values v;
+    struct List chain;
+    number value;
+    unsigned int next, n;
+
+    init_walk(&w);
+    enter_node(&w, root);
+    init_list(&chain);
+
+    v.value = v.small;
+    v.count = 0;
+    v.size = VALUES_INLINE;
+    next = 0;
+
+    /* every subtree that is left leaves its value on v */
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
+
+        if (step->state == 0 && p != NULL && next < p->node.count
+            && root == p->node.node[next]) {
+            push_value(&v, p->value[next++]);
+            w.count--;
+            continue;
+        }
+
+        switch (root->type) {
+        case NUMBER:
+            push_value(&v, root->data.value);
             break;
 
-        case MULTIPLY:
-            return (left * right);
+        case VARIABLE:
+            push_value(&v, (vars != NULL) ? vars[VARIABLE_SLOT(root)] : 0);
             break;
 
-        case DIVIDE:
-            return (left / right);
+        case OPERATOR:
+            if (step->state < 2) {
+                enter_node(&w, child_node(root, step->state++));
+                continue;
+            }
+
+            /* the operands of a chain stay on v until its top */
+            if (IS_CHAIN(root)) {
+                if (w.count > 1 && IN_CHAIN(w.step[w.count - 2].node,
+                                            root->data.op.operator))
+                    break;
+
+                n = get_operands(root, root->data.op.operator, &chain);
+                v.count -= n - 1;
+                v.value[v.count - 1] =
+                    combine_chain(v.value + v.count - 1, n,
+                                  root->data.op.operator);
+                break;
+            }
+
+            v.count--;
+            v.value[v.count - 1] =
+                calculate_operator(root->data.op.operator,
+                                   v.value[v.count - 1], v.value[v.count]);
             break;
 
-        case POWER:
-            return (pow(left, right));
+        case CONDITIONAL:
+            if (step->state == 0) {
+                step->state = 1;
+                enter_node(&w, root->data.con.condition);
+                continue;
+            }
+
+            /* only the chosen branch is calculated, its value
+             * replaces the value of the condition */
+            if (step->state == 1) {
+                step->state = 2;
+
+                if (v.value[--v.count])
+                    enter_node(&w, root->data.con.true);
+                else
+                    enter_node(&w, root->data.con.false);
+
+                continue;
+            }
             break;
 
-        case E_SYMBOL:
-            return (left * pow(10.0, right));
+        default:
+            push_value(&v, 0);
             break;
         }
-        break;
 
-    case CONDITIONAL:
-        if (calculate_parse_tree(root->data.con.condition))
-            return (calculate_parse_tree(root->data.con.true));
-        else
-            return (calculate_parse_tree(root->data.con.false));
-        break;
+        w.count--;
     }
 
-    return (0);
+    value = v.value[0];
+
+    if (v.value != v.small)
+        free(v.value);
+
+    free_list(&chain);
+    free_walk(&w);
+
+    return (value);
 }
 
-/* finds all variables in a tree
- * and save them in the 2nd argument
+/* finds the parts of a tree, the largest subtrees with at most
+ * the given number of nodes, the branches of a conditional are
+ * not split because only one of them is calculated and the inner
+ * nodes of a chain are no parts because its operands are combined
+ * at its top
  * 1. argument: pointer of the tree
- * 2. argument: adress of the pointer of a string
- *              (first call with empty string)
+ * 2. argument: maximal number of nodes of a part
+ * 3. argument: list that receives the parts
  * return value: none */
-static void find_variables(struct Node *root, char **var)
+static void split_tree(struct Node *root, uint32_t nodes, struct List *parts)
 {
-    char *i;
-    size_t temp;
+    struct Walk stack;
+    struct Node *child;
+    int inner, i;
+
+    /* the state of a step tells if it is an inner node of a chain */
+    init_walk(&stack);
+    enter_node(&stack, root);
+
+    /* the right child is taken last to keep the order of the tree */
+    while (stack.count > 0) {
+        stack.count--;
+        root = stack.step[stack.count].node;
+        inner = stack.step[stack.count].state;
+
+        if (root->size < PART_NODES)
+            continue;
+
+        if (root->size <= nodes && !inner) {
+            add_node(parts, root);
+            continue;
+        }
 
-    /* check type of node */
-    switch (root->type) {
-    case CONDITIONAL:
-        /* traverse tree */
-        find_variables(root->data.con.condition, var);
-        find_variables(root->data.con.true, var);
-        find_variables(root->data.con.false, var);
-        break;
+        if (root->type == OPERATOR)
+            for (i = 1; i >= 0; i--) {
+                child = child_node(root, i);
+                enter_node(&stack, child);
+                TOP_STEP(&stack)->state = IS_CHAIN(root)
+                    && IN_CHAIN(child, root->data.op.operator);
+            }
+        else if (root->type == CONDITIONAL)
+            enter_node(&stack, root->data.con.condition);
+    }
 
-    case OPERATOR:
-        /* traverse tree */
-        find_variables(root->data.op.left, var);
-        find_variables(root->data.op.right, var);
-        break;
+    free_walk(&stack);
+}
 
-    case VARIABLE:
-        for (i = *var; *i != '\0'; i++)
-            if (*i == root->data.name)
-                return;
+static void calculate_part(size_t i, void *data)
+{
+    struct Parts *p;
 
-        temp = strlen(*var);
+    p = data;
+    p->value[i] = calculate_tree(p->node.node[i], p->vars, NULL);
+}
 
-        if ((*var = realloc(*var, (temp + 2)
-                            * sizeof(char))) == NULL) {
-            perror("malloc");
-            exit(EXIT_FAILURE);
-        }
+/* calculates the value of a parse tree, the parts of a large tree are
+ * calculated on several threads first, every value is calculated like
+ * on one thread so the result does not depend on the threads
+ * 1. argument: pointer of the parse tree
+ * 2. argument: values of the variables a-z (NULL: all variables are 0)
+ * return value: the value of the parse tree */
+number calculate_parse_tree(struct Node *root, const number *vars)
+{
+    struct Parts p;
+    uint32_t nodes;
+    number value;
+    int threads;
 
-        (*var)[temp] = root->data.name;
+    threads = task_threads();
 
-        (*var)[temp + 1] = '\0';
-        break;
+    if (threads < 2 || root->size < PARALLEL_NODES)
+        return (calculate_tree(root, vars, NULL));
+
+    nodes = root->size / (PARTS_PER_THREAD * threads);
+
+    if (nodes < PART_NODES)
+        nodes = PART_NODES;
+
+    init_list(&p.node);
+    split_tree(root, nodes, &p.node);
+
+    /* a chain like "1+2+...+n" has one part only */
+    if (p.node.count < 2) {
+        free_list(&p.node);
+        return (calculate_tree(root, vars, NULL));
+    }
+
+    if ((p.value = malloc(p.node.count * sizeof(number))) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
+
+    p.vars = vars;
+    process_tasks(p.node.count, threads, calculate_part, &p);
+    value = calculate_tree(root, vars, &p);
+
+    free(p.value);
+    free_list(&p.node);
+
+    return (value);
 }
 
-/* searches a tree for variables
+/* variables of a tree sorted by their names, so the order of the
+ * questions does not depend on the order of the operands */
+struct Found {
+    char name[VARIABLES + 1];
+    int count;
+    unsigned long seen;         /* found or searched through their answer */
+};
+
+/* finds all variables in a tree that have no fixed value
+ * and adds them to the 2nd argument, variables that were already
+ * answered are searched through their answer instead,
+ * subtrees without new variables are skipped
  * 1. argument: pointer of the tree
- * return value: 0 if tree has no variables
- *               1 if tree has variables */
-static int has_variables(struct Node *root)
+ * 2. argument: the variables found (first call with none)
+ * 3. argument: fixed values of variables
+ * 4. argument: answers that are not calculated yet
+ * return value: none */
+static void find_variables(struct Node *root, struct Found *f,
+                           struct Bindings *b, struct Node **pending)
 {
-    int ret;
+    struct Node *hidden[VARIABLES];
+    unsigned long unknown;
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+    int slot, i;
 
-    ret = 0;
+    init_walk(&w);
+    enter_node(&w, root);
 
-    /* check type of node */
-    switch (root->type) {
-    case CONDITIONAL:
-        /* check subtree */
-        ret = has_variables(root->data.con.condition);
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
 
-        if (ret)
-            break;              /* subtree has a variable */
+        if (step->state == 0) {
+            unknown = root->variables & ~f->seen;
 
-        ret = has_variables(root->data.con.true);
+            if (b != NULL)
+                unknown &= ~b->bound;
 
-        if (ret)
-            break;
+            if (unknown == 0) {
+                w.count--;
+                continue;
+            }
+        }
 
-        ret = has_variables(root->data.con.false);
-        break;
+        if (root->type != VARIABLE) {
+            /* traverse tree */
+            if ((child = child_node(root, step->state++)) != NULL)
+                enter_node(&w, child);
+            else
+                w.count--;
 
-    case OPERATOR:
-        ret = has_variables(root->data.op.left);
+            continue;
+        }
 
-        if (ret)
-            break;
+        slot = VARIABLE_SLOT(root);
 
-        ret = has_variables(root->data.op.right);
-        break;
+        /* search the answer like it was written in place of the
+         * variable, it is hidden meanwhile to stop on cycles */
+        if (step->state == 0 && pending[slot] != NULL) {
+            hidden[slot] = pending[slot];
+            pending[slot] = NULL;
+            step->state = 1;
+            enter_node(&w, hidden[slot]);
+            continue;
+        }
 
-    case VARIABLE:
-        /* leaf is a variable */
-        return (1);
-        break;
+        if (step->state == 1)
+            pending[slot] = hidden[slot];
+        else {
+            /* insert the name in its place */
+            for (i = f->count; i > 0 && f->name[i - 1] > root->data.name;
+                 i--)
+                f->name[i] = f->name[i - 1];
+
+            f->name[i] = root->data.name;
+            f->name[++f->count] = '\0';
+        }
+
+        f->seen |= VARIABLE_BIT(root->data.name);
+        w.count--;
     }
 
-    return (ret);
+    free_walk(&w);
 }
 
-/* replaces one specific variable in a tree
- * 1. argument: variable
- * 2. argument: adress of the pointer of the tree
- * 3. argument: value of the variable (as a node)
- * return value: none */
-static void replace(char b, struct Node **root, struct Node *n)
+/* returns the number of a product of a number and another operand
+ * like "a*4", "4*a" or "2*(a-3)"
+ * 1. argument: pointer of the product
+ * 2. argument: pointer that receives the other operand
+ * return value: the node of the number or NULL if it is no such product */
+static struct Node *term_factor(struct Node *term, struct Node **other)
 {
-    /* check type of node */
-    switch ((*root)->type) {
-    case CONDITIONAL:
-        /* traverse tree */
-        replace(b, &((*root)->data.con.condition), n);
-        replace(b, &((*root)->data.con.true), n);
-        replace(b, &((*root)->data.con.false), n);
-        break;
+    struct Node *left, *right;
 
-    case OPERATOR:
-        /* traverse tree */
-        replace(b, &((*root)->data.op.left), n);
-        replace(b, &((*root)->data.op.right), n);
-        break;
+    if (term->type != OPERATOR || term->data.op.operator != MULTIPLY)
+        return (NULL);
 
-    case VARIABLE:
-        /* check variable */
-        if ((*root)->data.name == b)
-            *root = memcpy(*root, n, sizeof(struct Node));
-        break;
+    left = term->data.op.left;
+    right = term->data.op.right;
+
+    if (left->type != NUMBER && right->type == NUMBER) {
+        *other = left;
+        return (right);
     }
+
+    if (left->type == NUMBER && right->type != NUMBER) {
+        *other = right;
+        return (left);
+    }
+
+    return (NULL);
 }
 
-/* remove trivial things like "0 * a" or "b - b"
- * 1. argument: pointer of the tree
+/* takes an operand out of a chain of one operator like "a+b+c", its
+ * sibling takes the place of their parent, the operand gets no parent
+ * 1. argument: pointer of the chain
+ * 2. argument: pointer of the operand
+ * 3. argument: list that receives the nodes to delete
  * return value: none */
-void reduce(struct Node *root)
+static void remove_operand(struct Node *root, struct Node *operand,
+                           struct List *removed)
 {
-    struct Node *left, *right, *old,
-        *current, *current2, *a, *b, *c, *d, *parent;
-    struct List *all, *numbers, *operators, *variables;
-    struct Element *rem;
+    struct Node *parent, *sibling, *grandparent;
 
-    all = NULL;
-    numbers = NULL;
-    operators = NULL;
+    parent = operand->parent;
 
-    if (root == NULL)
+    if (parent->data.op.left == operand)
+        sibling = parent->data.op.right;
+    else
+        sibling = parent->data.op.left;
+
+    operand->parent = NULL;
+    add_node(removed, operand);
+
+    /* the root of the chain stays in its place */
+    if (parent == root) {
+        move_node(root, sibling);
+        sibling->parent = NULL;
+        add_node(removed, sibling);
         return;
+    }
 
-    sort_tree(root);
+    grandparent = parent->parent;
+
+    if (grandparent->data.op.left == parent)
+        grandparent->data.op.left = sibling;
+    else
+        grandparent->data.op.right = sibling;
+
+    sibling->parent = grandparent;
+    delete_node(parent);
+}
+
+/* adds up the numbers of a sum like "2+a+3" or multiplies the numbers
+ * of a product, operands of the chain may have become numbers after it
+ * was sorted, the numbers are combined like a chain of them in the
+ * compiled program (see combine_chain)
+ * 1. argument: pointer of the chain
+ * 2. argument: the operator of the chain
+ * return value: none */
+static void merge_numbers(struct Node *root, int operator)
+{
+    struct List all, removed;
+    struct Node *current, *first;
+    unsigned int i, n;
+    number *value;
+
+    init_list(&all);
+    init_list(&removed);
+
+    get_operands(root, operator, &all);
+
+    if ((value = malloc(all.count * sizeof(number))) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = n = 0, first = NULL; i < all.count; i++)
+        if (all.node[i]->type == NUMBER) {
+            if (first == NULL)
+                first = all.node[i];
+
+            value[n++] = all.node[i]->data.value;
+        }
+
+    /* the first number gets the value before the others are taken out,
+     * it may be moved into the place of the chain */
+    if (n > 1) {
+        first->data.value = combine_chain(value, n, operator);
+        hash_node(first);
+    }
+
+    for (i = 0; i < all.count; i++) {
+        current = all.node[i];
+
+        if (current->type != NUMBER || current == first
+            || current->parent == NULL)
+            continue;
+
+        remove_operand(root, current, &removed);
+    }
+
+    for (i = 0; i < removed.count; i++)
+        delete_tree(removed.node[i]);
+
+    free(value);
+    free_list(&all);
+    free_list(&removed);
+}
+
+/* merges the terms of one operand in a sum like "a*4+b+a*7+a" or
+ * "2*(a-3)+(a-3)", the numbers of the terms are added up, equal
+ * operands are counted
+ * 1. argument: pointer of the sum
+ * return value: none */
+static void merge_terms(struct Node *root)
+{
+    struct List all, operators, removed;
+    struct Node *current, *current2, *a, *b, *c, *x, *y;
+    unsigned int i, k;
+    number count;
+
+    init_list(&all);
+    init_list(&operators);
+    init_list(&removed);
+
+    get_operands(root, ADD, &all);
+
+    for (i = 0; i < all.count; i++)
+        if (all.node[i]->type == OPERATOR)
+            add_node(&operators, all.node[i]);
+
+    /* case: a*4+a*7 -> a*11, 2*(a-3)+3*(a-3) -> 5*(a-3) */
+    for (i = 0; i < operators.count; i++) {
+        current = operators.node[i];
+
+        if (current->parent == NULL
+            || (a = term_factor(current, &x)) == NULL)
+            continue;
+
+        for (k = i + 1; k < operators.count; k++) {
+            current2 = operators.node[k];
+
+            if (current2->parent != NULL
+                && (b = term_factor(current2, &y)) != NULL
+                && cmp_trees(x, y)) {
+                a->data.value += b->data.value;
+                hash_node(a);
+                hash_node(current);
+                remove_operand(root, current2, &removed);
+            }
+        }
+    }
+
+    /* case: 2*a+a -> 3*a, 2*(a-3)+(a-3) -> 3*(a-3) */
+    for (i = 0; i < operators.count; i++) {
+        current = operators.node[i];
+
+        if (current->parent == NULL
+            || (a = term_factor(current, &x)) == NULL)
+            continue;
+
+        for (k = 0; k < all.count; k++) {
+            c = all.node[k];
+
+            if (c->parent != NULL && c != current
+                && term_factor(c, &y) == NULL && cmp_trees(c, x)) {
+                a->data.value += 1.0;
+                hash_node(a);
+                hash_node(current);
+                remove_operand(root, c, &removed);
+            }
+        }
+    }
+
+    /* case: (a-3)+(a-3) -> 2*(a-3), equal operands are found by the
+     * order of the sorted tree and need not be neighbours */
+    for (i = 0; i < operators.count; i++) {
+        current = operators.node[i];
+
+        if (current->parent == NULL || term_factor(current, &x) != NULL)
+            continue;
+
+        count = 1.0;
+
+        for (k = i + 1; k < operators.count; k++) {
+            current2 = operators.node[k];
+
+            if (current2->parent != NULL && cmp_trees(current, current2)) {
+                count += 1.0;
+                remove_operand(root, current2, &removed);
+            }
+        }
+
+        if (count == 1.0)
+            continue;
+
+        /* the last removal moves the operand into the root */
+        if (current->parent == NULL)
+            current = root;
+
+        c = new_node();
+        move_node(c, current);
+        current->type = OPERATOR;
+        current->data.op.operator = MULTIPLY;
+        set_childs(current, new_number_node(count), c);
+    }
+
+    /* the operands are deleted when no list refers to them */
+    for (i = 0; i < removed.count; i++)
+        delete_tree(removed.node[i]);
+
+    free_list(&all);
+    free_list(&operators);
+    free_list(&removed);
+}
+
+/* remove trivial things like "0 * a" or "b - b" at one node of a
+ * sorted tree whose children are reduced already
+ * 1. argument: pointer of the node
+ * return value: none */
+static void reduce_step(struct Node *root)
+{
+    struct Node *left, *right, *old, *other;
 
     switch (root->type) {
     case OPERATOR:
-        reduce(root->data.op.left);
-        reduce(root->data.op.right);
-
         left = root->data.op.left;
         right = root->data.op.right;
 
@@ -246,14 +668,14 @@ void reduce(struct Node *root)
             }
 
             if (left->type == NUMBER && left->data.value == 0.0) {
-                memcpy(root, right, sizeof(struct Node));
+                move_node(root, right);
                 delete_node(left);
                 delete_node(right);
                 break;
             }
 
             if (right->type == NUMBER && right->data.value == 0.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(right);
                 delete_node(left);
                 break;
@@ -263,159 +685,35 @@ void reduce(struct Node *root)
                 root->data.op.operator = MULTIPLY;
                 left->type = NUMBER;
                 left->data.value = 2.0;
+                hash_node(left);
                 break;
             }
 
-            if (cmp_trees(left, right)) {
+            /* terms like "a*9+a*9" are merged with the others */
+            if (cmp_trees(left, right) && term_factor(left, &other) == NULL) {
                 root->data.op.operator = MULTIPLY;
                 delete_tree(left);
-                root->data.op.left = new_number_node(2.0);
+                set_childs(root, new_number_node(2.0), right);
                 break;
             }
 
-            all = get_operands(root, ADD);
-
-            if (all == NULL)
+            /* the whole sum is merged at its top */
+            if (root->parent != NULL && root->parent->type == OPERATOR
+                && root->parent->data.op.operator == ADD)
                 break;
 
-            numbers = new_list();
-            operators = new_list();
-            variables = new_list();
-
-            while (all->current != NULL) {
-                current = all->current->node;
-
-                if (current->type == OPERATOR)
-                    add_node(operators, current);
-                else if (current->type == NUMBER)
-                    add_node(numbers, current);
-                else if (current->type == VARIABLE)
-                    add_node(variables, current);
-
-                next_element(all);
-            }
-
-            rewind_list(operators);
-
-            /* case: a*4+a*7 -> a*11 */
-            while (operators->current != NULL) {
-                current = operators->current->node;
-
-                rem = operators->current;
-
-                if (current->data.op.operator == MULTIPLY) {
-                    next_element(operators);
-
-                    while (operators->current != NULL) {
-                        current2 = operators->current->node;
-
-                        if (current2->data.op.operator == MULTIPLY) {
-                            a = current->data.op.left;
-                            b = current->data.op.right;
-                            c = current2->data.op.left;
-                            d = current2->data.op.right;
-
-                            if (a->type == OPERATOR || b->type == OPERATOR
-                                || c->type == OPERATOR
-                                || d->type == OPERATOR) {
-                                next_element(operators);
-                                continue;
-                            }
-
-                            /* 4 cases: */
-                            if (a->type == VARIABLE && b->type == NUMBER
-                                && c->type == VARIABLE
-                                && d->type == NUMBER)
-                                b->data.value += d->data.value;
-                            else if (a->type == VARIABLE
-                                     && b->type == NUMBER
-                                     && c->type == NUMBER
-                                     && d->type == VARIABLE)
-                                b->data.value += c->data.value;
-                            else if (a->type == NUMBER
-                                     && b->type == VARIABLE
-                                     && c->type == VARIABLE
-                                     && d->type == NUMBER)
-                                a->data.value += d->data.value;
-                            else if (a->type == NUMBER
-                                     && b->type == VARIABLE
-                                     && c->type == NUMBER
-                                     && d->type == VARIABLE)
-                                a->data.value += c->data.value;
-                            else {
-                                next_element(operators);
-                                continue;
-                            }
-
-                            parent = get_parent(root, current2);
-
-                            old = parent->data.op.left;
-                            memcpy(parent, parent->data.op.left,
-                                   sizeof(struct Node));
-                            delete_node(old);
-
-                            delete_tree(current2);
-                        }
-
-                        next_element(operators);
-                    }
-                }
-
-                operators->current = rem;
-                next_element(operators);
-            }
-
-            rewind_list(operators);
-
-            /* case: 2*a+a -> 3*a */
-            while (operators->current != NULL) {
-                current = operators->current->node;
-
-                if (current->data.op.operator == MULTIPLY) {
-                    rewind_list(variables);
-
-                    a = current->data.op.left;
-                    b = current->data.op.right;
-
-                    while (variables->current != NULL) {
-                        c = variables->current->node;
-
-                        /* 2 cases */
-                        if (a->type == VARIABLE && b->type == NUMBER
-                            && a->data.name == c->data.name)
-                            b->data.value += 1.0;
-                        else if (a->type == NUMBER && b->type == VARIABLE
-                                 && b->data.name == c->data.name)
-                            a->data.value += 1.0;
-                        else {
-                            next_element(variables);
-                            continue;
-                        }
-
-                        parent = get_parent(root, c);
-
-                        old = parent->data.op.left;
-                        memcpy(parent, parent->data.op.left,
-                               sizeof(struct Node));
-                        delete_node(old);
-                        delete_node(c);
-
-                        next_element(variables);
-                    }
-                }
-
-                next_element(operators);
-            }
-
-            delete_list_without_nodes(operators);
-            delete_list_without_nodes(numbers);
-            delete_list_without_nodes(variables);
-            delete_list_without_nodes(all);
+            merge_numbers(root, ADD);
+
+            if (root->type == OPERATOR && root->data.op.operator == ADD)
+                merge_terms(root);
+
+            /* terms were merged inside the sum */
+            hash_chain(root, ADD);
             break;
 
         case MINUS:
             if (left->type == NUMBER && right->type == NUMBER) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 root->data.value = left->data.value - right->data.value;
                 delete_node(left);
                 delete_node(right);
@@ -431,7 +729,7 @@ void reduce(struct Node *root)
             }
 
             if (right->type == NUMBER && right->data.value == 0.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(right);
                 delete_node(left);
                 break;
@@ -444,18 +742,11 @@ void reduce(struct Node *root)
                 delete_tree(right);
                 break;
             }
-
-            all = get_operands(root, MINUS);
-
-            if (all == NULL)
-                break;
-
-            delete_list_without_nodes(all);
             break;
 
         case MULTIPLY:
             if (left->type == NUMBER && right->type == NUMBER) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 root->data.value = left->data.value * right->data.value;
                 delete_node(left);
                 delete_node(right);
@@ -472,14 +763,14 @@ void reduce(struct Node *root)
             }
 
             if (left->type == NUMBER && left->data.value == 1.0) {
-                memcpy(root, right, sizeof(struct Node));
+                move_node(root, right);
                 delete_node(left);
                 delete_node(right);
                 break;
             }
 
             if (right->type == NUMBER && right->data.value == 1.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(right);
                 delete_node(left);
                 break;
@@ -489,20 +780,24 @@ void reduce(struct Node *root)
                 root->data.op.operator = POWER;
                 right->type = NUMBER;
                 right->data.value = 2.0;
+                hash_node(right);
                 break;
             }
 
-            all = get_operands(root, MULTIPLY);
-
-            if (all == NULL)
+            /* the whole product is merged at its top */
+            if (root->parent != NULL && root->parent->type == OPERATOR
+                && root->parent->data.op.operator == MULTIPLY)
                 break;
 
-            delete_list_without_nodes(all);
+            merge_numbers(root, MULTIPLY);
+
+            /* numbers were merged inside the product */
+            hash_chain(root, MULTIPLY);
             break;
 
         case DIVIDE:
             if (left->type == NUMBER && right->type == NUMBER) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 root->data.value = left->data.value / right->data.value;
                 delete_node(left);
                 delete_node(right);
@@ -534,7 +829,7 @@ void reduce(struct Node *root)
             }
 
             if (right->type == NUMBER && right->data.value == 1.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(right);
                 delete_node(left);
                 break;
@@ -547,20 +842,13 @@ void reduce(struct Node *root)
                 delete_tree(right);
                 break;
             }
-
-            all = get_operands(root, DIVIDE);
-
-            if (all == NULL)
-                break;
-
-            delete_list_without_nodes(all);
             break;
 
         case POWER:
             if (left->type == NUMBER && right->type == NUMBER) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 root->data.value =
-                    pow(left->data.value, right->data.value);
+                    number_pow(left->data.value, right->data.value);
                 delete_node(left);
                 delete_node(right);
                 break;
@@ -583,32 +871,25 @@ void reduce(struct Node *root)
             }
 
             if (right->type == NUMBER && right->data.value == 1.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(left);
                 delete_node(right);
                 break;
             }
 
             if (left->type == NUMBER && left->data.value == 1.0) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(right);
                 delete_node(left);
                 break;
             }
-
-            all = get_operands(root, POWER);
-
-            if (all == NULL)
-                break;
-
-            delete_list_without_nodes(all);
             break;
 
         case E_SYMBOL:
             if (left->type == NUMBER && right->type == NUMBER) {
                 root->type = NUMBER;
                 root->data.value =
-                    left->data.value * pow(10.0, right->data.value);
+                    left->data.value * number_pow(10, right->data.value);
                 delete_node(left);
                 delete_node(right);
                 break;
@@ -622,18 +903,14 @@ void reduce(struct Node *root)
         left = root->data.con.true;
         right = root->data.con.false;
 
-        reduce(root->data.con.condition);
-        reduce(root->data.con.true);
-        reduce(root->data.con.false);
-
         if (root->data.con.condition->type == NUMBER) {
             if (root->data.con.condition->data.value) {
-                memcpy(root, left, sizeof(struct Node));
+                move_node(root, left);
                 delete_node(old);
                 delete_node(left);
                 delete_tree(right);
             } else {
-                memcpy(root, right, sizeof(struct Node));
+                move_node(root, right);
                 delete_node(old);
                 delete_tree(left);
                 delete_node(right);
@@ -641,33 +918,209 @@ void reduce(struct Node *root)
         }
         break;
     }
+
+    /* the node may have been rewritten, its subtrees have their hashes */
+    hash_node(root);
 }
 
-/* replace all variables in a tree by asking the user for values
- * 1. argument: adress of the pointer of the tree
+/* a subtree without variables becomes its value, like the reductions
+ * of reduce_step() would do step by step
+ * 1. argument: pointer of the subtree
+ * return value: 1 if the subtree was calculated, 0 if not */
+static int fold_constant(struct Node *root)
+{
+    number value;
+
+    if (root->variables != 0 || root->type == NUMBER)
+        return (0);
+
+    value = calculate_parse_tree(root, NULL);
+
+    if (root->type == CONDITIONAL) {
+        delete_tree(root->data.con.condition);
+        delete_tree(root->data.con.true);
+        delete_tree(root->data.con.false);
+    } else {
+        delete_tree(root->data.op.left);
+        delete_tree(root->data.op.right);
+    }
+
+    root->type = NUMBER;
+    root->data.value = value;
+    hash_node(root);
+
+    return (1);
+}
+
+/* remove trivial things like "0 * a" or "b - b" from a sorted tree,
+ * the children of a node are reduced before the node
+ * 1. argument: pointer of the tree
+ * return value: none */
+static void reduce_node(struct Node *root)
+{
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+
+    if (root == NULL)
+        return;
+
+    init_walk(&w);
+    enter_node(&w, root);
+
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
+
+        if (step->state == 0 && fold_constant(root)) {
+            w.count--;
+            continue;
+        }
+
+        if ((child = child_node(root, step->state++)) != NULL) {
+            enter_node(&w, child);
+            continue;
+        }
+
+        w.count--;
+        reduce_step(root);
+    }
+
+    free_walk(&w);
+}
+
+/* remove trivial things like "0 * a" or "b - b",
+ * the operands are sorted once before,
+ * afterwards every node of the tree has its hash
+ * 1. argument: pointer of the tree
+ * return value: none */
+void reduce(struct Node *root)
+{
+    if (root == NULL)
+        return;
+
+    sort_tree(root);
+    reduce_node(root);
+}
+
+/* searches a tree for a variable without a value
+ * 1. argument: pointer of the tree
+ * 2. argument: fixed values of variables
+ * return value: lowest name of such a variable or 0 if there is none */
+char unbound_variable(struct Node *root, struct Bindings *env)
+{
+    struct Found found;
+    struct Node *pending[VARIABLES] = { NULL };
+
+    memset(&found, 0, sizeof(found));
+    find_variables(root, &found, env, pending);
+
+    return (found.name[0]);
+}
+
+/* calculates the answers of all variables of a tree, the answers
+ * of variables they refer to are calculated first
+ * 1. argument: pointer of the tree
+ * 2. argument: environment that receives the values
+ * 3. argument: answers that are not calculated yet
  * return value: none
  */
-void replace_variables(struct Node **root)
+static void settle_variables(struct Node *root, struct Bindings *env,
+                             struct Node **pending)
 {
-    char *variables, *i;
-    char input[MAX_INPUT];
-    struct Node *value;
+    struct Node *settling[VARIABLES];
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+    int slot;
+
+    init_walk(&w);
+    enter_node(&w, root);
+
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
+
+        /* every variable of the subtree has its value */
+        if (step->state == 0 && (root->variables & ~env->bound) == 0) {
+            w.count--;
+            continue;
+        }
 
-    while (has_variables(*root)) {
-        /* create emtpy string */
-        if ((variables = calloc(1, sizeof(char))) == NULL) {
-            perror("calloc");
-            exit(EXIT_FAILURE);
+        if (root->type != VARIABLE) {
+            if ((child = child_node(root, step->state++)) != NULL)
+                enter_node(&w, child);
+            else
+                w.count--;
+
+            continue;
+        }
+
+        slot = VARIABLE_SLOT(root);
+
+        if (step->state == 0) {
+            /* the answer is being calculated already */
+            if (pending[slot] == NULL) {
+                fflush(stdout);
+                fprintf(stderr, "\nvariable %c refers to itself\n",
+                        root->data.name);
+                exit(EXIT_FAILURE);
+            }
+
+            /* the variables of the answer are settled first */
+            settling[slot] = pending[slot];
+            pending[slot] = NULL;
+            step->state = 1;
+            enter_node(&w, settling[slot]);
+            continue;
         }
 
-        /* find all variables in tree */
-        find_variables(*root, &variables);
+        env->value[slot] = calculate_parse_tree(settling[slot], env->value);
+        env->bound |= 1UL << slot;
+
+        delete_tree(settling[slot]);
+        w.count--;
+    }
+
+    free_walk(&w);
+}
+
+/* asks the user for the values of all variables of a tree
+ * that have no value yet, the tree itself is not changed
+ * 1. argument: pointer of the tree
+ * 2. argument: environment that receives the values
+ * return value: none
+ */
+void ask_variables(struct Node *root, struct Bindings *env)
+{
+    struct Found found;
+    char *i;
+    char input[MAX_INPUT];
+    struct Node *value, *pending[VARIABLES] = { NULL };
+    int asked;
+
+    do {
+        asked = 0;
+
+        /* find all variables in tree and in the answers */
+        memset(&found, 0, sizeof(found));
+        find_variables(root, &found, env, pending);
+
+        for (i = found.name; *i != '\0'; i++) {
+            if (pending[*i - 'a'] != NULL)
+                continue;
 
-        for (i = variables; *i != '\0'; i++) {
             /* ask for value of variable */
             printf("value of variable %c: ", *i);
-            fgets(input, MAX_INPUT - 1, stdin);
-            input[strlen(input) - 1] = '\0';
+
+            if (fgets(input, MAX_INPUT - 1, stdin) == NULL) {
+                fflush(stdout);
+                fprintf(stderr, "\nno value for variable %c\n", *i);
+                exit(EXIT_FAILURE);
+            }
+
+            if (strchr(input, '\n') != NULL)
+                *strchr(input, '\n') = '\0';
 
             /* create parse tree */
             value = parse(input);
@@ -680,13 +1133,12 @@ void replace_variables(struct Node **root)
 
             reduce(value);
 
-            /* replace variable in tree */
-            replace(*i, root, value);
-
-            delete_node(value);
+            /* the answer may contain other variables, they are
+             * asked for in the next round */
+            pending[*i - 'a'] = value;
+            asked = 1;
         }
+    } while (asked);
 
-        /* free memory of string */
-        free(variables);
-    }
+    settle_variables(root, env, pending);
 }
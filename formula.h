@@ -22,7 +22,10 @@
 #define FP_FORMULA_H
 
 extern void reduce(struct Node *);
-extern void replace_variables(struct Node **);
-extern long double calculate_parse_tree(struct Node *root);
+struct Bindings;
+
+extern void ask_variables(struct Node *, struct Bindings *);
+extern char unbound_variable(struct Node *, struct Bindings *);
+extern number calculate_parse_tree(struct Node *root, const number *);
 
 #endif
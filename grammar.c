@@ -18,62 +18,16 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
-#include <ctype.h>
 
+#include "arena.h"
 #include "node.h"
 #include "grammar.h"
 
-#define GRAMMAR_PARSER(X) struct Node *X(struct Tokenizer *tokenizer)
-
-/* prototypes of static functions */
-
-static GRAMMAR_PARSER(T);
-static GRAMMAR_PARSER(S);
-static GRAMMAR_PARSER(P);
-static GRAMMAR_PARSER(O);
-static GRAMMAR_PARSER(K);
-static GRAMMAR_PARSER(Num);
-static GRAMMAR_PARSER(N);
-static GRAMMAR_PARSER(Z);
-static GRAMMAR_PARSER(Var);
-static GRAMMAR_PARSER(B);
-
-struct Node *parse(char *string)
-{
-    struct Tokenizer *tokenizer;
-    struct Node *root;
-    int position;
-    char c;
-
-    tokenizer = create_tokenizer(string);
-
-    root = T(tokenizer);
-
-    position = tokenizer->position;
-    c = CURRENT_TOKEN;
-
-    free_tokenizer(tokenizer);
-
-    if (!root) {
-        if (c == '\0')
-            printf("unexpected end of string\n");
-        else
-            printf("syntax error at position %d near '%c'\n", position, c);
-
-        return (NULL);
-    }
-
-    if (c != '\0') {
-        printf("expecting end at position %d near '%c'\n", position, c);
-        delete_tree(root);
-        return (NULL);
-    }
-
-    return (root);
-}
-
 /* Grammar:
  * T   -> S | S ? S : S
  * S   -> P | P + P | P - P
@@ -86,366 +40,475 @@ struct Node *parse(char *string)
  * Var -> B | BZ
  * B   -> [a-z] */
 
-/* function for conditional expression operators
- * T -> S | S '?' S ':' S */
-GRAMMAR_PARSER(T)
+/* kinds of unfinished parts of a formula on the stack of the parser */
+#define PENDING_NEGATION    0   /* '-' K */
+#define PENDING_PARENTHESIS 1   /* '(' T ')' */
+#define PENDING_BINARY      2   /* left operand and operator */
+#define PENDING_CONDITION   3   /* S '?' S ':' S, true part is parsed */
+#define PENDING_ALTERNATIVE 4   /* S '?' S ':' S, false part is parsed */
+
+/* states of the parser */
+#define EXPECT_OPERAND 0        /* start of K */
+#define AFTER_OPERAND  1        /* behind K, O may go on with '^' */
+#define AFTER_POWER    2        /* behind O */
+
+/* initial number of entries of the stack */
+#define STACK_SIZE 64
+
+/* precedences of the binary operators, higher binds stronger
+ * (T -> S '?' S ':' S has the lowest precedence) */
+static const unsigned char precedence[UCHAR_MAX + 1] = {
+    ['+'] = 1, ['-'] = 1,
+    ['*'] = 2, ['/'] = 2,
+    ['^'] = 3
+};
+
+struct Pending {
+    int kind;
+    char operator;
+    struct Node *left;
+    struct Node *middle;
+};
+
+/* explicit stack of the parser instead of recursive descent */
+struct Stack {
+    struct Pending *entry;
+    size_t count;
+    size_t size;
+};
+
+static void push(struct Stack *s, int kind, char operator,
+                 struct Node *left, struct Node *middle)
 {
-    struct Node *condition, *true, *false;
-
-    /* T -> S */
-    condition = S(tokenizer);
-
-    if (!condition)
-        /* syntax error in S -> return error */
-        return (NULL);
-
-    /* T -> S '?' S ':' S */
-    while (CURRENT_TOKEN == '?') {
-        SKIP_TOKEN;
-
-        true = S(tokenizer);
-
-        if (!true) {
-            /* syntax error in S -> cleanup -> return error */
-            delete_tree(condition);
-            return (NULL);
-        }
-
-        if (CURRENT_TOKEN != ':') {
-            /* local syntax error -> cleanup -> return error */
-            delete_tree(true);
-            delete_tree(condition);
-            return (NULL);
-        }
-
-        SKIP_TOKEN;
-
-        false = S(tokenizer);
+    if (s->count == s->size) {
+        s->size = s->size ? 2 * s->size : STACK_SIZE;
 
-        if (!false) {
-            /* syntax error in S -> cleanup -> return error */
-            delete_tree(condition);
-            delete_tree(true);
-            return (NULL);
+        if ((s->entry = realloc(s->entry, s->size
+                                * sizeof(struct Pending))) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
         }
-
-        condition = new_conditional_node(condition, true, false);
     }
 
-    return (condition);
+    s->entry[s->count].kind = kind;
+    s->entry[s->count].operator = operator;
+    s->entry[s->count].left = left;
+    s->entry[s->count].middle = middle;
+    s->count++;
 }
 
-/* function for addition and subtraction signs
- * S -> P | P '+' P | P '-' P */
-static GRAMMAR_PARSER(S)
+/* the last entry of the stack or NULL if it is empty */
+static struct Pending *top(struct Stack *s)
 {
-    struct Node *subtree, *right, *op;
+    return (s->count ? &s->entry[s->count - 1] : NULL);
+}
 
-    /* S -> P */
-    subtree = P(tokenizer);
+/* combines the binary operators on the stack with the operand as
+ * long as they bind at least as strong as the given precedence
+ * 1. argument: the stack
+ * 2. argument: the right operand
+ * 3. argument: the precedence
+ * return value: the combined operand */
+static struct Node *combine(struct Stack *s, struct Node *right, int p)
+{
+    struct Pending *t;
 
-    if (!subtree)
-        return (NULL);
+    while ((t = top(s)) != NULL && t->kind == PENDING_BINARY
+           && precedence[(unsigned char) t->operator] >= p) {
+        right = set_childs(new_operator_node(t->operator), t->left, right);
+        s->count--;
+    }
 
-    /* S -> P '+' P | P '-' P */
-    while (CURRENT_TOKEN == '+' || CURRENT_TOKEN == '-') {
-        op = new_operator_node(CURRENT_TOKEN);
+    return (right);
+}
 
-        SKIP_TOKEN;
+/* frees all unfinished parts of a formula after a syntax error
+ * 1. argument: the stack
+ * 2. argument: the current operand (or NULL)
+ * return value: always NULL */
+static struct Node *discard(struct Stack *s, struct Node *operand)
+{
+    if (operand != NULL)
+        delete_tree(operand);
 
-        right = P(tokenizer);
+    while (s->count > 0) {
+        s->count--;
 
-        if (!right) {
-            /* cleanup and return Error */
-            delete_node(op);
-            delete_tree(subtree);
-            return (NULL);
-        }
+        if (s->entry[s->count].left != NULL)
+            delete_tree(s->entry[s->count].left);
 
-        subtree = set_childs(op, subtree, right);
+        if (s->entry[s->count].middle != NULL)
+            delete_tree(s->entry[s->count].middle);
     }
 
-    return (subtree);
+    free(s->entry);
+
+    return (NULL);
 }
 
-/* function for multiplication and division signs
- * P -> O | O '*' O | O '/' O | OVar */
-static GRAMMAR_PARSER(P)
+/* reads digits
+ * Z -> [0-9]+
+ * return value: a number node or NULL if there is no digit */
+static struct Node *digits(struct Tokenizer *tokenizer)
 {
-    struct Node *subtree, *right, *op;
+    number nr;
 
-    /* P -> O */
-    subtree = O(tokenizer);
+    nr = 0.0;
 
-    if (!subtree)
+    if (CURRENT_CLASS != TOKEN_DIGIT)
         return (NULL);
 
-    /* P -> OVar */
-    while (islower(CURRENT_TOKEN)) {
-        right = Var(tokenizer);
-
-        if (!right) {
-            delete_node(subtree);
-            return (NULL);
-        }
+    while (CURRENT_CLASS == TOKEN_DIGIT) {
+        nr = nr * 10 + (CURRENT_TOKEN - '0');
 
-        subtree = set_childs(new_operator_node('*'), subtree, right);
+        SKIP_TOKEN;
     }
 
-    /* P -> O '*' O | O '/' O */
-    while (CURRENT_TOKEN == '*' || CURRENT_TOKEN == '/') {
-        op = new_operator_node(CURRENT_TOKEN);
+    return (new_number_node(nr));
+}
 
-        SKIP_TOKEN;
+/* characters of a number that are collected on the stack */
+#define LITERAL_SIZE 64
 
-        right = O(tokenizer);
+/* characters of a number without spaces */
+struct Literal {
+    char *text;
+    size_t length;
+    size_t size;
+    char small[LITERAL_SIZE];
+};
 
-        if (!right) {
-            delete_node(op);
-            delete_tree(subtree);
-            return (NULL);
-        }
+static void append_literal(struct Literal *l, char c)
+{
+    if (l->length + 1 == l->size) {
+        l->size *= 2;
 
-        subtree = set_childs(op, subtree, right);
+        if (l->text == l->small) {
+            if ((l->text = malloc(l->size)) == NULL) {
+                perror("malloc");
+                exit(EXIT_FAILURE);
+            }
+
+            memcpy(l->text, l->small, l->length);
+        } else if ((l->text = realloc(l->text, l->size)) == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
     }
 
-    return (subtree);
+    l->text[l->length++] = c;
+    l->text[l->length] = '\0';
 }
 
-/* function for exponentiations
- * O -> K | K '^' K */
-static GRAMMAR_PARSER(O)
+/* appends the digits of the current tokens
+ * return value: number of digits */
+static int append_digits(struct Tokenizer *tokenizer, struct Literal *l)
 {
-    struct Node *subtree, *right;
-
-    /* O -> K */
-    subtree = K(tokenizer);
+    int count;
 
-    if (!subtree)
-        return (NULL);
+    for (count = 0; CURRENT_CLASS == TOKEN_DIGIT; count++) {
+        append_literal(l, CURRENT_TOKEN);
 
-    /* O -> K '^' K */
-    while (CURRENT_TOKEN == '^') {
         SKIP_TOKEN;
-
-        right = K(tokenizer);
-
-        if (!right) {
-            delete_tree(subtree);
-            return (NULL);
-        }
-
-        subtree = set_childs(new_operator_node('^'), subtree, right);
     }
 
-    return (subtree);
+    return (count);
 }
 
-/* function for signed terms, braces, numbers and variables
- * K -> -K | (T) | Num | Var */
-static GRAMMAR_PARSER(K)
+/* reads a number (maybe with a point and an 'E') into one node,
+ * the value is correctly rounded
+ * Num -> N | N 'E' Z | N 'E' '-' Z
+ * N   -> Z | Z '.' Z
+ * return value: the number node or NULL on a syntax error */
+static struct Node *literal(struct Tokenizer *tokenizer)
 {
+    struct Literal l;
     struct Node *subtree;
+    int valid;
 
-    /* K -> -K */
-    if (CURRENT_TOKEN == '-') {
-        SKIP_TOKEN;
+    l.text = l.small;
+    l.length = 0;
+    l.size = LITERAL_SIZE;
+    subtree = NULL;
+    valid = 1;
 
-        subtree = K(tokenizer);
+    /* N -> Z */
+    append_digits(tokenizer, &l);
 
-        if (!subtree)
-            return (NULL);
+    /* N -> Z '.' Z */
+    if (CURRENT_TOKEN == '.' || CURRENT_TOKEN == ',') {
+        /* skip point */
+        SKIP_TOKEN;
 
-        subtree = set_childs(new_operator_node('*'),
-                             new_number_node(-1), subtree);
-        return (subtree);
+        append_literal(&l, '.');
+        append_digits(tokenizer, &l);
     }
 
-    /* K -> (T) */
-    if (CURRENT_TOKEN == '(') {
+    if (CURRENT_TOKEN == 'E') {
+        /* skip E symbol */
         SKIP_TOKEN;
 
-        subtree = T(tokenizer);
-
-        if (!subtree)
-            return (NULL);
+        append_literal(&l, 'E');
 
-        if (CURRENT_TOKEN == ')') {
+        /* Num -> N 'E' '-' Z */
+        if (CURRENT_TOKEN == '-') {
             SKIP_TOKEN;
-            return (subtree);
+
+            append_literal(&l, '-');
         }
 
-        /* cleanup and return Error */
-        delete_tree(subtree);
-        return (NULL);
+        /* Num -> N 'E' Z, the exponent needs digits */
+        if (append_digits(tokenizer, &l) == 0)
+            valid = 0;
     }
 
-    /* K -> Num */
-    if (isdigit(CURRENT_TOKEN)) {
-        subtree = Num(tokenizer);
-        return (subtree);
-    }
+    if (valid)
+        subtree = new_number_node(decimal_to_number(l.text));
 
-    /* K -> Var */
-    if (islower(CURRENT_TOKEN)) {
-        subtree = Var(tokenizer);
-        return (subtree);
-    }
+    if (l.text != l.small)
+        free(l.text);
 
-    /* Syntax Error */
-    return (NULL);
+    return (subtree);
 }
 
-/* function for numbers (maybe with an 'E')
- * Num -> N | N 'E' Z | N 'E' '-' Z */
-static GRAMMAR_PARSER(Num)
+/* reads a variable
+ * Var -> B | BZ
+ * B   -> [a-z]
+ * return value: the subtree */
+static struct Node *variable(struct Tokenizer *tokenizer)
 {
-    struct Node *subtree, *right;
+    struct Node *subtree;
 
-    /* Num -> N */
-    subtree = N(tokenizer);     /* get number */
+    subtree = new_variable_node(CURRENT_TOKEN);
 
-    if (!subtree)
-        return (NULL);
+    SKIP_TOKEN;
 
-    if (CURRENT_TOKEN == 'E') {
-        /* skip E symbol */
-        SKIP_TOKEN;
+    /* Var -> BZ */
+    if (CURRENT_CLASS == TOKEN_DIGIT)
+        subtree = set_childs(new_operator_node('^'), subtree,
+                             digits(tokenizer));
 
-        /* Num -> N 'E' '-' Z */
-        if (CURRENT_TOKEN == '-') {
-            /* skip subtraction sign */
-            SKIP_TOKEN;
+    return (subtree);
+}
 
-            /* get number */
-            right = Z(tokenizer);
+/* parses a formula with an explicit stack (precedence climbing),
+ * deep nesting of braces and signs needs no recursion
+ * T -> S | S '?' S ':' S
+ * 1. argument: the tokenizer
+ * return value: the parse tree or NULL on a syntax error, the current
+ *               token is where the parser stopped */
+static struct Node *parse_tokens(struct Tokenizer *tokenizer)
+{
+    struct Stack stack;
+    struct Pending *t;
+    struct Node *operand;
+    int state;
+    unsigned char class;
+    char c;
 
-            if (!right) {
-                delete_tree(subtree);
-                return (NULL);
+    stack.entry = NULL;
+    stack.count = stack.size = 0;
+    operand = NULL;
+    state = EXPECT_OPERAND;
+
+    for (;;) {
+        c = CURRENT_TOKEN;
+        class = CURRENT_CLASS;
+
+        switch (state) {
+        case EXPECT_OPERAND:
+            /* K -> -K | (T) */
+            if (c == '-' || c == '(') {
+                push(&stack, c == '-' ? PENDING_NEGATION
+                     : PENDING_PARENTHESIS, c, NULL, NULL);
+                SKIP_TOKEN;
+                break;
             }
 
-            right = set_childs(new_operator_node('*'),
-                               new_number_node(-1), right);
-
-            subtree = set_childs(new_operator_node('E'), subtree, right);
-        } else {
-            /* Num -> N 'E' Z */
-
-            /* get number */
-            right = Z(tokenizer);
+            /* K -> Num | Var */
+            if (class == TOKEN_DIGIT) {
+                if ((operand = literal(tokenizer)) == NULL)
+                    return (discard(&stack, NULL));
+            } else if (class == TOKEN_LOWER)
+                operand = variable(tokenizer);
+            else
+                return (discard(&stack, NULL));
+
+            /* K -> -K */
+            while ((t = top(&stack)) != NULL
+                   && t->kind == PENDING_NEGATION) {
+                operand = set_childs(new_operator_node('*'),
+                                     new_number_node(-1), operand);
+                stack.count--;
+            }
 
-            if (!right) {
-                delete_tree(subtree);
-                return (NULL);
+            state = AFTER_OPERAND;
+            break;
+
+        case AFTER_OPERAND:
+            /* O -> K '^' K */
+            if (c == '^') {
+                operand = combine(&stack, operand, precedence['^']);
+                push(&stack, PENDING_BINARY, c, operand, NULL);
+                operand = NULL;
+                SKIP_TOKEN;
+                state = EXPECT_OPERAND;
+                break;
             }
 
-            subtree = set_childs(new_operator_node('E'), subtree, right);
-        }
-    }
+            operand = combine(&stack, operand, precedence['^']);
+            state = AFTER_POWER;
+            break;
+
+        case AFTER_POWER:
+            t = top(&stack);
+
+            /* P -> OVar, only before the first '*' or '/' */
+            if (class == TOKEN_LOWER
+                && !(t != NULL && t->kind == PENDING_BINARY
+                     && precedence[(unsigned char) t->operator]
+                     == precedence['*'])) {
+                operand = set_childs(new_operator_node('*'), operand,
+                                     variable(tokenizer));
+                break;
+            }
 
-    return (subtree);
-}
+            /* P -> O '*' O | O '/' O, S -> P '+' P | P '-' P */
+            if (c == '*' || c == '/' || c == '+' || c == '-') {
+                operand = combine(&stack, operand,
+                                  precedence[(unsigned char) c]);
+                push(&stack, PENDING_BINARY, c, operand, NULL);
+                operand = NULL;
+                SKIP_TOKEN;
+                state = EXPECT_OPERAND;
+                break;
+            }
 
-/* function for numbers
- * N -> Z | Z '.' Z */
-static GRAMMAR_PARSER(N)
-{
-    struct Node *subtree;
-    long double nr;
-    int digits;
+            /* end of S */
+            operand = combine(&stack, operand, 1);
+            t = top(&stack);
+
+            /* the true part must end with ':' */
+            if (t != NULL && t->kind == PENDING_CONDITION) {
+                if (c != ':')
+                    return (discard(&stack, operand));
+
+                t->kind = PENDING_ALTERNATIVE;
+                t->middle = operand;
+                operand = NULL;
+                SKIP_TOKEN;
+                state = EXPECT_OPERAND;
+                break;
+            }
 
-    /* N -> Z */
-    subtree = Z(tokenizer);
+            /* T -> S '?' S ':' S, chained to the left */
+            if (t != NULL && t->kind == PENDING_ALTERNATIVE) {
+                operand = new_conditional_node(t->left, t->middle,
+                                               operand);
+                stack.count--;
+                t = top(&stack);
+            }
 
-    if (!subtree)
-        return (NULL);
+            if (c == '?') {
+                push(&stack, PENDING_CONDITION, c, operand, NULL);
+                operand = NULL;
+                SKIP_TOKEN;
+                state = EXPECT_OPERAND;
+                break;
+            }
 
-    /* N -> Z '.' Z */
-    if (CURRENT_TOKEN == '.' || CURRENT_TOKEN == ',') {
-        /* skip point */
-        SKIP_TOKEN;
+            /* end of T */
+            if (t == NULL) {
+                free(stack.entry);
+                return (operand);
+            }
 
-        nr = subtree->data.value;
-        digits = 0;
+            /* K -> (T) */
+            if (c != ')')
+                return (discard(&stack, operand));
 
-        while (isdigit(CURRENT_TOKEN)) {
-            digits++;
+            stack.count--;
+            SKIP_TOKEN;
 
-            nr += (CURRENT_TOKEN - '0') / pow(10.0, digits);
+            /* K -> -K */
+            while ((t = top(&stack)) != NULL
+                   && t->kind == PENDING_NEGATION) {
+                operand = set_childs(new_operator_node('*'),
+                                     new_number_node(-1), operand);
+                stack.count--;
+            }
 
-            SKIP_TOKEN;
+            state = AFTER_OPERAND;
+            break;
         }
-
-        subtree->data.value = nr;
     }
-
-    return (subtree);
 }
 
-/* function for digits
- * Z -> [0-9]+ */
-static GRAMMAR_PARSER(Z)
+struct Node *parse(char *string)
 {
-    struct Node *subtree;
-    long double number;
-
-    subtree = NULL;
-    number = 0.0;
-
-    if (!isdigit(CURRENT_TOKEN))
-        return (NULL);
+    return (parse_report(string, strlen(string), stdout));
+}
 
-    while (isdigit(CURRENT_TOKEN)) {
-        number = number * 10.0 + (CURRENT_TOKEN - '0');
+/* creates a parse tree
+ * 1. argument: string of the formula (needs no '\0')
+ * 2. argument: length of the string
+ * 3. argument: file that receives the syntax errors
+ * return value: the parse tree or NULL on a syntax error */
+struct Node *parse_report(const char *string, size_t length, FILE *errors)
+{
+    struct Tokenizer t, *tokenizer;
+    struct Node *root;
+    int position;
+    char c;
 
-        SKIP_TOKEN;
-    }
+    tokenizer = &t;
+    init_tokenizer(tokenizer, string, length);
 
-    subtree = new_number_node(number);
+    root = parse_tokens(tokenizer);
 
-    return (subtree);
-}
+    position = TOKEN_POSITION(tokenizer);
+    c = CURRENT_TOKEN;
 
-/* function for variables
- * Var -> B | BZ */
-static GRAMMAR_PARSER(Var)
-{
-    struct Node *subtree, *right;
+    free_tokenizer(tokenizer);
 
-    subtree = B(tokenizer);
+    if (!root) {
+        if (c == '\0')
+            fprintf(errors, "unexpected end of string\n");
+        else
+            fprintf(errors, "syntax error at position %d near '%c'\n",
+                    position, c);
 
-    if (!subtree)
         return (NULL);
+    }
 
-    /* Var -> BZ */
-    if (isdigit(CURRENT_TOKEN)) {
-        right = Z(tokenizer);
-
-        if (!right) {
-            delete_tree(subtree);
-            return (NULL);
-        }
-
-        subtree = set_childs(new_operator_node('^'), subtree, right);
+    if (c != '\0') {
+        fprintf(errors, "expecting end at position %d near '%c'\n",
+                position, c);
+        delete_tree(root);
+        return (NULL);
     }
 
-    return (subtree);
+    return (root);
 }
 
-/* function for characters
- * B -> [a-z] */
-static GRAMMAR_PARSER(B)
+/* creates a parse tree whose nodes are allocated from an arena
+ * 1. argument: string of the formula
+ * 2. argument: adress of the pointer of the arena
+ *              (a new arena is created if it points to NULL)
+ * return value: the parse tree, it is freed together with the arena
+ *               by reset_arena() or delete_arena() of the caller */
+struct Node *parse_arena(char *string, struct Arena **a)
 {
-    struct Node *subtree;
-
-    subtree = NULL;
+    struct Arena *old;
+    struct Node *root;
 
-    if (islower(CURRENT_TOKEN)) {
-        subtree = new_variable_node(CURRENT_TOKEN);
+    if (*a == NULL)
+        *a = new_arena();
 
-        SKIP_TOKEN;
-    }
+    old = set_arena(*a);
+    root = parse(string);
+    set_arena(old);
 
-    return (subtree);
+    return (root);
 }
+
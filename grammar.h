@@ -21,8 +21,14 @@
 #ifndef FP_GRAMMAR_H
 #define FP_GRAMMAR_H
 
+#include <stdio.h>
+
 #include "tokenizer.h"
 
+struct Arena;
+
 extern struct Node *parse(char *);
+extern struct Node *parse_report(const char *, size_t, FILE *);
+extern struct Node *parse_arena(char *, struct Arena **);
 
 #endif
@@ -0,0 +1,166 @@
+/*
+    fp - input.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "input.h"
+
+/* opens a file of formulas
+ * 1. argument: name of the file ("-" for the standard input)
+ * return value: pointer of the input or NULL if it cannot be opened */
+struct Input *open_input(const char *filename)
+{
+    struct Input *in;
+    struct stat st;
+
+    if ((in = calloc(1, sizeof(struct Input))) == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(filename, "-") == 0)
+        in->fd = STDIN_FILENO;
+    else if ((in->fd = open(filename, O_RDONLY)) == -1) {
+        perror("open");
+        free(in);
+        return (NULL);
+    }
+
+    if (fstat(in->fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        in->mapped = in->end = 1;
+
+        /* nothing to map */
+        if (st.st_size == 0)
+            return (in);
+
+        in->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in->fd, 0);
+
+        if (in->data != MAP_FAILED) {
+            in->length = st.st_size;
+            madvise(in->data, in->length, MADV_SEQUENTIAL);
+            return (in);
+        }
+
+        in->mapped = in->end = 0;
+    }
+
+    /* pipes and files that cannot be mapped */
+    in->size = INPUT_BUFFER_SIZE;
+
+    if ((in->data = malloc(in->size)) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    return (in);
+}
+
+/* gets the next line of a file without the '\n', the line is not copied,
+ * it is valid until the next call (or until the input is closed if the
+ * file is mapped)
+ * 1. argument: pointer of the input
+ * 2. argument: adress of the pointer to the line
+ * 3. argument: adress of the length of the line
+ * return value: 1 if there was a line, 0 at the end of the file */
+int next_line(struct Input *in, const char **line, size_t *length)
+{
+    char *start, *newline;
+    ssize_t r;
+
+    for (;;) {
+        start = in->data + in->position;
+        newline = NULL;
+
+        if (in->length > in->position + in->checked)
+            newline = memchr(start + in->checked, '\n',
+                             in->length - in->position - in->checked);
+
+        if (newline != NULL) {
+            *line = start;
+            *length = newline - start;
+            in->position += *length + 1;
+            in->checked = 0;
+            return (1);
+        }
+
+        in->checked = in->length - in->position;
+
+        if (in->end) {
+            /* the last line has no '\n' */
+            if (in->checked == 0)
+                return (0);
+
+            *line = start;
+            *length = in->checked;
+            in->position = in->length;
+            in->checked = 0;
+            return (1);
+        }
+
+        /* keep the beginning of the line and read more */
+        memmove(in->data, start, in->checked);
+        in->length = in->checked;
+        in->position = 0;
+
+        if (in->length == in->size) {
+            in->size *= 2;
+
+            if ((in->data = realloc(in->data, in->size)) == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        r = read(in->fd, in->data + in->length, in->size - in->length);
+
+        if (r == -1) {
+            perror("read");
+            exit(EXIT_FAILURE);
+        }
+
+        if (r == 0)
+            in->end = 1;
+
+        in->length += r;
+    }
+}
+
+void close_input(struct Input *in)
+{
+    if (in == NULL)
+        return;
+
+    if (in->mapped) {
+        if (in->length > 0)
+            munmap(in->data, in->length);
+    } else
+        free(in->data);
+
+    if (in->fd != STDIN_FILENO)
+        close(in->fd);
+
+    free(in);
+}
@@ -0,0 +1,46 @@
+/*
+    fp - input.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_INPUT_H
+#define FP_INPUT_H
+
+#include <stddef.h>
+
+/* initial size of the buffer for pipes */
+#define INPUT_BUFFER_SIZE (1 << 20)
+
+/* a file of formulas, regular files are mapped into memory,
+ * pipes are read through a buffer that is reused */
+struct Input {
+    int fd;
+    char *data;
+    size_t length;              /* valid bytes of data */
+    size_t position;            /* start of the next line */
+    size_t checked;             /* bytes behind position without '\n' */
+    size_t size;                /* size of the buffer */
+    char mapped;
+    char end;                   /* no more bytes to read */
+};
+
+extern struct Input *open_input(const char *);
+extern int next_line(struct Input *, const char **, size_t *);
+extern void close_input(struct Input *);
+
+#endif
@@ -0,0 +1,384 @@
+/*
+    fp - jit.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "program.h"
+#include "jit.h"
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* longest machine code of one instruction */
+#define MAX_INSTRUCTION 64
+
+struct Fixup {
+    size_t position;            /* of the rel32 */
+    uint32_t target;            /* instruction of the program */
+};
+
+struct Emitter {
+    unsigned char *code;
+    size_t length;
+};
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p;
+
+    if ((p = calloc(n ? n : 1, size)) == NULL) {
+        perror("calloc(jit)");
+        exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+static void byte(struct Emitter *e, unsigned char b)
+{
+    e->code[e->length++] = b;
+}
+
+static void bytes(struct Emitter *e, const char *b, size_t n)
+{
+    memcpy(e->code + e->length, b, n);
+    e->length += n;
+}
+
+static void imm32(struct Emitter *e, uint32_t v)
+{
+    memcpy(e->code + e->length, &v, 4);
+    e->length += 4;
+}
+
+static void imm64(struct Emitter *e, uint64_t v)
+{
+    memcpy(e->code + e->length, &v, 8);
+    e->length += 8;
+}
+
+/* SSE2 instruction xmm, [rsp + 8 * slot]
+ * 1. argument: emitter
+ * 2. argument: opcode (0x10 movsd load, 0x11 movsd store,
+ *              0x58 addsd, 0x59 mulsd, 0x5c subsd, 0x5e divsd)
+ * 3. argument: register xmm0 or xmm1
+ * 4. argument: slot of the value stack */
+static void sse_slot(struct Emitter *e, unsigned char opcode, int xmm,
+                     uint32_t slot)
+{
+    byte(e, 0xf2);
+    byte(e, 0x0f);
+    byte(e, opcode);
+    byte(e, 0x84 | (xmm << 3));  /* [rsp + disp32] */
+    byte(e, 0x24);
+    imm32(e, slot * 8);
+}
+
+/* packed SSE2 instruction xmm, [rsp + 8 * slot] on two values
+ * 1. argument: emitter
+ * 2. argument: opcode (0x10 movupd load, 0x11 movupd store)
+ * 3. argument: register xmm0 or xmm1
+ * 4. argument: first slot of the two values */
+static void packed_slot(struct Emitter *e, unsigned char opcode, int xmm,
+                        uint32_t slot)
+{
+    byte(e, 0x66);
+    byte(e, 0x0f);
+    byte(e, opcode);
+    byte(e, 0x84 | (xmm << 3));  /* [rsp + disp32] */
+    byte(e, 0x24);
+    imm32(e, slot * 8);
+}
+
+/* combines slots pairwise like the interpreter (the upper half with the
+ * lower half until one value is left), two values at once
+ * 1. argument: emitter
+ * 2. argument: opcode (0x58 add, 0x59 mul)
+ * 3. argument: first slot
+ * 4. argument: number of slots */
+static void combine_slots(struct Emitter *e, unsigned char opcode,
+                          uint32_t first, uint32_t n)
+{
+    uint32_t i, half;
+
+    for (; n > 1; n = half) {
+        half = (n + 1) / 2;
+
+        for (i = 0; i + half < n; i += 2) {
+            if (i + 1 + half < n) {
+                /* addpd/mulpd xmm0, xmm1 */
+                packed_slot(e, 0x10, 0, first + i);
+                packed_slot(e, 0x10, 1, first + i + half);
+                byte(e, 0x66);
+                byte(e, 0x0f);
+                byte(e, opcode);
+                byte(e, 0xc1);
+                packed_slot(e, 0x11, 0, first + i);
+            } else {
+                sse_slot(e, 0x10, 0, first + i);
+                sse_slot(e, opcode, 0, first + i + half);
+                sse_slot(e, 0x11, 0, first + i);
+            }
+        }
+    }
+}
+
+/* mov rax, imm64; call rax */
+static void call(struct Emitter *e, uint64_t function)
+{
+    bytes(e, "\x48\xb8", 2);
+    imm64(e, function);
+    bytes(e, "\xff\xd0", 2);
+}
+
+static uint64_t function_address(double (*f) (double, double))
+{
+    uint64_t a;
+
+    memcpy(&a, &f, sizeof(a));
+
+    return (a);
+}
+
+/* compiles a program into x86-64 machine code
+ * the values of the program stack live in slots on the machine stack,
+ * the variables are read relative to rbx (the argument of the function)
+ * 1. argument: pointer of the program
+ * return value: compiled function or NULL */
+struct Jit *jit_compile(struct Program *p)
+{
+    struct Emitter e;
+    struct Fixup *fixups;
+    struct Jit *jit;
+    size_t *offset, size, fixup_count;
+    uint32_t i, frame, depth, *depth_at;
+    int32_t rel;
+    double d;
+    uint64_t bits;
+    void *mem;
+
+    if (p == NULL || p->length == 0)
+        return (NULL);
+
+    size = 64 + (size_t) p->length * MAX_INSTRUCTION;
+
+    /* a sum or product needs code for every operand */
+    for (i = 0; i < p->length; i++)
+        if (p->code[i].opcode == OP_SUM || p->code[i].opcode == OP_PRODUCT)
+            size += (size_t) p->code[i].arg * MAX_INSTRUCTION / 2;
+
+    mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED) {
+        perror("mmap");
+        return (NULL);
+    }
+
+    e.code = mem;
+    e.length = 0;
+
+    offset = xcalloc(p->length + 1, sizeof(size_t));
+    fixups = xcalloc(p->length, sizeof(struct Fixup));
+    depth_at = xcalloc(p->length + 1, sizeof(uint32_t));
+    fixup_count = 0;
+
+    /* keep rsp aligned to 16 bytes for calls to pow(),
+     * the temporaries are kept above the stack */
+    frame = (((p->depth + p->temporaries) * 8) + 15) & ~15u;
+
+    /* push rbx; mov rbx, rdi; sub rsp, frame */
+    bytes(&e, "\x53\x48\x89\xfb\x48\x81\xec", 7);
+    imm32(&e, frame);
+
+    depth = 0;
+
+    for (i = 0; i < p->length; i++) {
+        offset[i] = e.length;
+
+        /* behind an unconditional jump continues a false branch */
+        if (i > 0 && p->code[i - 1].opcode == OP_JMP)
+            depth = depth_at[i];
+
+        switch (p->code[i].opcode) {
+        case OP_PUSH:
+            d = p->constant_double[p->code[i].arg];
+            memcpy(&bits, &d, sizeof(bits));
+
+            /* mov rax, imm64; mov [rsp + disp32], rax */
+            bytes(&e, "\x48\xb8", 2);
+            imm64(&e, bits);
+            bytes(&e, "\x48\x89\x84\x24", 4);
+            imm32(&e, depth * 8);
+            depth++;
+            break;
+
+        case OP_LOAD:
+            /* movsd xmm0, [rbx + disp32] */
+            bytes(&e, "\xf2\x0f\x10\x83", 4);
+            imm32(&e, p->code[i].arg * 8);
+            sse_slot(&e, 0x11, 0, depth);
+            depth++;
+            break;
+
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_DIV:
+            depth--;
+            sse_slot(&e, 0x10, 0, depth - 1);
+            sse_slot(&e,
+                     p->code[i].opcode == OP_ADD ? 0x58 :
+                     p->code[i].opcode == OP_SUB ? 0x5c :
+                     p->code[i].opcode == OP_MUL ? 0x59 : 0x5e,
+                     0, depth);
+            sse_slot(&e, 0x11, 0, depth - 1);
+            break;
+
+        case OP_POW:
+            depth--;
+            sse_slot(&e, 0x10, 0, depth - 1);
+            sse_slot(&e, 0x10, 1, depth);
+            call(&e, function_address(pow));
+            sse_slot(&e, 0x11, 0, depth - 1);
+            break;
+
+        case OP_EXP10:
+            depth--;
+            d = 10.0;
+            memcpy(&bits, &d, sizeof(bits));
+
+            /* mov rax, 10.0; movq xmm0, rax */
+            bytes(&e, "\x48\xb8", 2);
+            imm64(&e, bits);
+            bytes(&e, "\x66\x48\x0f\x6e\xc0", 5);
+            sse_slot(&e, 0x10, 1, depth);
+            call(&e, function_address(pow));
+            sse_slot(&e, 0x59, 0, depth - 1);
+            sse_slot(&e, 0x11, 0, depth - 1);
+            break;
+
+        case OP_JZ:
+            depth--;
+            depth_at[p->code[i].arg] = depth;
+
+            /* xorpd xmm1, xmm1; ucomisd xmm0, xmm1;
+             * jp +6 (NaN is true); je rel32 */
+            sse_slot(&e, 0x10, 0, depth);
+            bytes(&e, "\x66\x0f\x57\xc9\x66\x0f\x2e\xc1\x7a\x06\x0f\x84",
+                  12);
+            fixups[fixup_count].position = e.length;
+            fixups[fixup_count++].target = p->code[i].arg;
+            imm32(&e, 0);
+            break;
+
+        case OP_JMP:
+            byte(&e, 0xe9);
+            fixups[fixup_count].position = e.length;
+            fixups[fixup_count++].target = p->code[i].arg;
+            imm32(&e, 0);
+            break;
+
+        case OP_STORE:
+            sse_slot(&e, 0x10, 0, depth - 1);
+            sse_slot(&e, 0x11, 0, p->depth + p->code[i].arg);
+            break;
+
+        case OP_FETCH:
+            sse_slot(&e, 0x10, 0, p->depth + p->code[i].arg);
+            sse_slot(&e, 0x11, 0, depth);
+            depth++;
+            break;
+
+        case OP_SUM:
+        case OP_PRODUCT:
+            depth -= p->code[i].arg - 1;
+            combine_slots(&e, p->code[i].opcode == OP_SUM ? 0x58 : 0x59,
+                          depth - 1, p->code[i].arg);
+            break;
+        }
+    }
+
+    offset[p->length] = e.length;
+
+    /* movsd xmm0, [rsp]; add rsp, frame; pop rbx; ret */
+    sse_slot(&e, 0x10, 0, 0);
+    bytes(&e, "\x48\x81\xc4", 3);
+    imm32(&e, frame);
+    bytes(&e, "\x5b\xc3", 2);
+
+    for (i = 0; i < fixup_count; i++) {
+        rel = (int32_t) (offset[fixups[i].target]
+                         - (fixups[i].position + 4));
+        memcpy(e.code + fixups[i].position, &rel, 4);
+    }
+
+    free(offset);
+    free(fixups);
+    free(depth_at);
+
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        perror("mprotect");
+        munmap(mem, size);
+        return (NULL);
+    }
+
+    jit = xcalloc(1, sizeof(struct Jit));
+    jit->code = mem;
+    jit->size = size;
+    memcpy(&jit->function, &mem, sizeof(jit->function));
+
+    return (jit);
+}
+
+void delete_jit(struct Jit *jit)
+{
+    if (jit == NULL)
+        return;
+
+    munmap(jit->code, jit->size);
+    free(jit);
+}
+
+#else
+
+/* no native code generator for this architecture,
+ * the caller falls back to run_program() */
+struct Jit *jit_compile(struct Program *p)
+{
+    (void) p;
+
+    return (NULL);
+}
+
+void delete_jit(struct Jit *jit)
+{
+    (void) jit;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+    fp - jit.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_JIT_H
+#define FP_JIT_H
+
+#include <stddef.h>
+
+#include "program.h"
+
+/* compiled formula, vars holds the values of a-z */
+typedef double (*jit_function) (const double *vars);
+
+struct Jit {
+    unsigned char *code;
+    size_t size;
+    jit_function function;
+};
+
+extern struct Jit *jit_compile(struct Program *);
+extern void delete_jit(struct Jit *);
+
+#endif
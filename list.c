@@ -20,118 +20,137 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "list.h"
 
-struct List *new_list(void)
+/* creates an empty list
+ * 1. argument: pointer of the list
+ * return value: none */
+void init_list(struct List *l)
 {
-    struct List *n;
+    l->node = l->small;
+    l->count = 0;
+    l->size = LIST_INLINE;
+}
 
-    if ((n = malloc(sizeof(struct List))) == NULL) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
-    }
+void add_node(struct List *l, struct Node *n)
+{
+    struct Node **node;
 
-    n->first = NULL;
-    n->last = NULL;
-    n->current = NULL;
-    n->count = 0;
+    /* the array is doubled when it is full */
+    if (l->count == l->size) {
+        if ((node = malloc(2 * l->size * sizeof(struct Node *))) == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
 
-    return (n);
-}
+        memcpy(node, l->node, l->count * sizeof(struct Node *));
 
-struct Element *new_element(struct Node *n)
-{
-    struct Element *e;
+        if (l->node != l->small)
+            free(l->node);
 
-    if ((e = malloc(sizeof(struct Element))) == NULL) {
-        perror("malloc");
-        exit(EXIT_FAILURE);
+        l->node = node;
+        l->size *= 2;
     }
 
-    e->node = n;
-    e->next = NULL;
-
-    return (e);
+    l->node[l->count++] = n;
 }
 
-void add_node(struct List *l, struct Node *n)
+/* frees the memory of a list, the nodes are not deleted
+ * 1. argument: pointer of the list
+ * return value: none */
+void free_list(struct List *l)
 {
-    struct Element *e;
+    if (l->node != l->small)
+        free(l->node);
 
-#ifdef DEBUG
-    if (l == NULL || n == NULL) {
-        fprintf(stderr,
-                "add_node (l == NULL || n == NULL)  l=0x%08x n=0x%08x\n",
-                l, n);
-        exit(EXIT_FAILURE);
-    }
-#endif
+    init_list(l);
+}
 
-    e = new_element(n);
+/* merges two sorted parts of an array, equal nodes of the first part
+ * come first
+ * 1. argument: the array
+ * 2. argument: array that receives the merged nodes
+ * 3. argument: index of the first part
+ * 4. argument: index of the second part
+ * 5. argument: index after the second part
+ * 6. argument: the order of the nodes
+ * return value: none */
+static void merge(struct Node **from, struct Node **to, unsigned int begin,
+                  unsigned int middle, unsigned int end,
+                  compare_function compare)
+{
+    unsigned int i, k, n;
 
-    /* empty list */
-    if (l->first == NULL) {
-        l->first = e;
-        l->last = e;
-    } else {
-        l->last->next = e;
-        l->last = e;
+    for (i = begin, k = middle, n = begin; n < end; n++) {
+        if (k == end || (i < middle && compare(from[i], from[k]) <= 0))
+            to[n] = from[i++];
+        else
+            to[n] = from[k++];
     }
-
-    l->current = l->first;
-    l->count++;
 }
 
-void delete_list_without_nodes(struct List *old)
+/* sorts the nodes of a list, nodes that are equal keep their order
+ * 1. argument: pointer of the list
+ * 2. argument: the order of the nodes
+ * return value: none */
+void sort_list(struct List *l, compare_function compare)
 {
-    struct Element *current, *delete;
+    struct Node **from, **to, **temp, *n;
+    unsigned int i, k, width, begin, middle, end;
 
-    if (old == NULL)
-        return;
+    /* short runs are sorted by insertion */
+    for (begin = 0; begin < l->count; begin += LIST_INLINE) {
+        end = begin + LIST_INLINE < l->count ? begin + LIST_INLINE
+            : l->count;
 
-    current = old->first;
+        for (i = begin + 1; i < end; i++) {
+            n = l->node[i];
 
-    while (current != NULL) {
-        delete = current;
-        current = current->next;
-        free(delete);
+            for (k = i; k > begin && compare(l->node[k - 1], n) > 0; k--)
+                l->node[k] = l->node[k - 1];
+
+            l->node[k] = n;
+        }
     }
 
-    free(old);
-}
+    if (l->count <= LIST_INLINE)
+        return;
 
-void delete_list(struct List *old)
-{
-    struct Element *current, *delete;
+    if ((temp = malloc(l->count * sizeof(struct Node *))) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
 
-    if (old == NULL)
-        return;
+    from = l->node;
+    to = temp;
 
-    current = old->first;
+    for (width = LIST_INLINE; width < l->count; width *= 2) {
+        for (begin = 0; begin < l->count; begin += 2 * width) {
+            middle = begin + width < l->count ? begin + width : l->count;
+            end = middle + width < l->count ? middle + width : l->count;
+            merge(from, to, begin, middle, end, compare);
+        }
 
-    while (current != NULL) {
-        delete_node(current->node);
-        delete = current;
-        current = current->next;
-        free(delete);
+        temp = from;
+        from = to;
+        to = temp;
     }
 
-    free(old);
+    if (from != l->node)
+        memcpy(l->node, from, l->count * sizeof(struct Node *));
+
+    free(from == l->node ? to : from);
 }
 
 void print_list(struct List *l)
 {
-    if (l == NULL)
-        printf("list is NULL\n");
-
-    l->current = l->first;
+    unsigned int i;
 
-    while (l->current != NULL) {
-        print_node(l->current->node);
+    for (i = 0; i < l->count; i++) {
+        print_node(l->node[i]);
         printf("\n");
-
-        l->current = l->current->next;
     }
 
     if (l->count == 0)
@@ -140,24 +159,6 @@ void print_list(struct List *l)
         if (l->count == 1)
             printf("the list has one element\n");
         else
-            printf("the list has %d elements\n", l->count);
+            printf("the list has %u elements\n", l->count);
     }
-
-    rewind_list(l);
-}
-
-void rewind_list(struct List *l)
-{
-    if (l == NULL)
-        return;
-
-    l->current = l->first;
-}
-
-void next_element(struct List *l)
-{
-    if (l == NULL || l->current == NULL)
-        return;
-
-    l->current = l->current->next;
 }
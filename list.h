@@ -23,25 +23,26 @@
 
 #include "node.h"
 
+/* number of nodes a list keeps without allocating memory */
+#define LIST_INLINE 8
+
+/* nodes in a growing array, short lists use the array inside the list
+ * (a list must not be copied, node may point into it)
+ * the nodes are node[0] ... node[count - 1] */
 struct List {
-    struct Element *first;
-    struct Element *last;
-    struct Element *current;
+    struct Node **node;
     unsigned int count;
+    unsigned int size;
+    struct Node *small[LIST_INLINE];
 };
 
-struct Element {
-    struct Node *node;
-    struct Element *next;
-};
+/* order of two nodes, negative, zero or positive like strcmp() */
+typedef int (*compare_function)(struct Node *, struct Node *);
 
-extern struct List *new_list(void);
-extern struct Element *new_element(struct Node *);
+extern void init_list(struct List *);
 extern void add_node(struct List *, struct Node *);
-extern void delete_list(struct List *);
+extern void free_list(struct List *);
+extern void sort_list(struct List *, compare_function);
 extern void print_list(struct List *);
-extern void delete_list_without_nodes(struct List *);
-extern void rewind_list(struct List *);
-extern void next_element(struct List *);
 
 #endif
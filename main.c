@@ -18,15 +18,46 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <limits.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 
+#include "arena.h"
 #include "node.h"
 #include "grammar.h"
 #include "formula.h"
+#include "program.h"
+#include "jit.h"
+#include "batch.h"
+#include "bindings.h"
+#include "parallel.h"
+#include "input.h"
+#include "cache.h"
+
+/* short options, a ':' follows the options with a value */
+#define OPTIONS "f:p:hnJj:T:t:D:C:SH"
+
+/* settings for the calculation of every formula */
+struct Options {
+    short precision;
+    int type;
+    char just_print;
+    char native;
+    char print_term;
+    char statistics;
+    char share;
+    struct Table *table;
+    struct Bindings *bindings;
+    struct Cache *cache;
+};
+
+static const struct option long_options[] = {
+    {"bindings", required_argument, NULL, 'B'},
+    {NULL, 0, NULL, 0}
+};
 
 void print_usage()
 {
@@ -36,26 +67,255 @@ void print_usage()
            "under certain conditions.\n\n"
            "usage: fp [OPTIONS] FORMULA...\n"
            "possible options:\n"
-           "    -f [FILE]         read formulas from file\n"
+           "    -f [FILE]         read formulas from file ('-': standard\n"
+           "                      input, variables need -D or --bindings)\n"
            "    -p [PRECISION]    set the precision of the output\n"
-           "    -n                just print results\n");
+           "    -n                just print results\n"
+           "    -J                compile formulas to native code\n"
+           "    -j [THREADS]      calculate the formulas of a file on\n"
+           "                      several threads, else very large\n"
+           "                      formulas (default: all processors)\n"
+           "    -t [TYPE]         calculate with float, double, ldouble or\n"
+           "                      float128 (default: %s)\n"
+           "    -T [FILE]         calculate the formulas for every row of a\n"
+           "                      table (first line: names of the columns)\n"
+           "    -D [VAR=VALUE]    set the value of a variable\n"
+           "    --bindings [FILE] read VAR=VALUE lines from a file\n"
+           "    -C [SIZE]         keep the compiled form of SIZE formulas\n"
+           "                      (default: %d, 0: keep none)\n"
+           "    -S                print the statistics of the cache\n"
+           "    -H                calculate equal subtrees only once\n",
+           number_type_name(NUMBER_TYPE), CACHE_SIZE);
+}
+
+/* checks if an argument is a formula that starts with '-' ("-3+4",
+ * "--3", "-(1+2)"), getopt would read it as options
+ * 1. argument: the argument
+ * return value: 1 if it is such a formula, else 0 */
+static int negative_formula(const char *arg)
+{
+    if (arg[0] != '-' || arg[1] == '\0')
+        return (0);
+
+    /* long options */
+    if (arg[1] == '-')
+        return (arg[2] != '\0' && !isalpha((unsigned char) arg[2]));
+
+    return (arg[1] == ':' || strchr(OPTIONS, arg[1]) == NULL);
+}
+
+/* checks if the value of an option is the next argument
+ * ("-D a=1", "-nD a=1" or "--bindings FILE", but not "-Da=1")
+ * 1. argument: the argument
+ * return value: 1 if the next argument is a value, else 0 */
+static int value_follows(const char *arg)
+{
+    const char *option;
+    size_t length;
+
+    if (arg[0] != '-')
+        return (0);
+
+    /* long option, it may be abbreviated */
+    if (arg[1] == '-') {
+        length = strlen(arg);
+        return (length > 2 && strncmp(arg, "--bindings", length) == 0);
+    }
+
+    for (arg++; *arg != '\0'; arg++) {
+        if (*arg == ':' || (option = strchr(OPTIONS, *arg)) == NULL)
+            return (0);
+
+        if (option[1] == ':')
+            return (arg[1] == '\0');
+    }
+
+    return (0);
+}
+
+/* compiles a reduced parse tree and keeps the result in the cache
+ * 1. argument: string of the formula (needs no '\0')
+ * 2. argument: length of the string
+ * 3. argument: pointer of the parse tree
+ * 4. argument: settings of the calculation
+ * return value: the compiled formula, it has to be released */
+static struct CacheEntry *compile_formula(const char *term, size_t length,
+                                          struct Node *parse_tree,
+                                          struct Options *o)
+{
+    struct Program *program;
+
+    /* equal subtrees are calculated once */
+    if (o->share)
+        share_tree(parse_tree);
+
+    program = compile_tree(parse_tree);
+
+    return (add_formula(o->cache, term, length, program,
+                        o->native ? jit_compile(program) : NULL));
+}
+
+/* calculates a compiled formula and prints the result
+ * 1. argument: string of the formula (needs no '\0')
+ * 2. argument: length of the string
+ * 3. argument: the compiled formula
+ * 4. argument: values of the variables
+ * 5. argument: settings of the calculation
+ * 6. argument: file that receives the results
+ * 7. argument: file that receives the error messages
+ * return value: none */
+static void calculate(const char *term, size_t length,
+                      struct CacheEntry *formula, struct Bindings *env,
+                      struct Options *o,
+                      FILE *output, FILE *errors)
+{
+    struct Program *program;
+    double vars[VARIABLES], *results;
+    wide_number result;
+    size_t row;
+    int c;
+
+    program = formula->program;
+
+    /* calculate the formula for all rows of the table */
+    if (o->table != NULL) {
+        if ((c = missing_column(program, o->table, env)) != 0)
+            fprintf(errors, "no column for variable %c in %.*s\n", c,
+                    (int) length, term);
+        else {
+            results = calloc(o->table->rows + 1, sizeof(double));
+
+            if (results == NULL) {
+                perror("calloc");
+                exit(EXIT_FAILURE);
+            }
+
+            /* fixed values stand for the variables without a column */
+            for (c = 0; c < VARIABLES; c++)
+                vars[c] = (double) env->value[c];
+
+            run_program_columns(program, o->table->column, vars,
+                                o->table->rows, results);
+
+            for (row = 0; row < o->table->rows; row++) {
+                if (o->just_print)
+                    fprintf(output, "%.*f\n", o->precision, results[row]);
+                else
+                    fprintf(output, "%.*s = %.*f\n", (int) length, term,
+                            o->precision,
+                            results[row]);
+            }
+
+            free(results);
+        }
+
+        return;
+    }
+
+    /* without native code run the program */
+    if (formula->jit != NULL) {
+        for (c = 0; c < VARIABLES; c++)
+            vars[c] = (double) env->value[c];
+
+        result = formula->jit->function(vars);
+    } else
+        result = run_program_type(program, o->type, env->value);
+
+    /* print result */
+    if (o->print_term)
+        fprintf(output, "%.*s = ", (int) length, term);
+
+    print_number(output, o->precision, result);
+    fprintf(output, "\n");
+}
+
+/* calculates one line of a file on a worker thread,
+ * variables without a fixed value cannot be asked for
+ * 1. argument: string of the formula (needs no '\0')
+ * 2. argument: length of the string
+ * 3. argument: file that receives the results
+ * 4. argument: file that receives the error messages
+ * 5. argument: settings of the calculation
+ * return value: none */
+static void calculate_line(const char *term, size_t length, FILE *output,
+                           FILE *errors, void *data)
+{
+    struct Options *o;
+    struct Node *parse_tree;
+    struct CacheEntry *formula;
+    struct Bindings env;
+    char c;
+
+    o = data;
+
+    /* repeated formulas are not parsed again */
+    if ((formula = find_formula(o->cache, term, length)) == NULL) {
+        /* create parse tree */
+        if ((parse_tree = parse_report(term, length, output)) == NULL) {
+            fprintf(errors, "cannot create parse tree for %.*s\n",
+                    (int) length, term);
+            return;
+        }
+
+        reduce(parse_tree);
+        formula = compile_formula(term, length, parse_tree, o);
+    }
+
+    if (o->bindings != NULL)
+        env = *o->bindings;
+    else
+        memset(&env, 0, sizeof(env));
+
+    if (o->table == NULL && (c = missing_value(formula->program, &env)) != 0)
+        fprintf(errors, "no value for variable %c in %.*s\n", c,
+                (int) length, term);
+    else
+        calculate(term, length, formula, &env, o, output, errors);
+
+    release_formula(o->cache, formula);
+}
+
+/* prints the statistics of the cache and frees the settings
+ * 1. argument: settings of the calculation
+ * return value: none */
+static void finish(struct Options *o)
+{
+    if (o->statistics) {
+        fflush(stdout);
+        print_cache_statistics(o->cache, stderr);
+    }
+
+    delete_cache(o->cache);
+    delete_table(o->table);
+    delete_bindings(o->bindings);
 }
 
 int main(int argc, char *argv[])
 {
     struct Node *parse_tree;
-    long double result;
-    int i;
-    short precision;
-    char fromfile, just_print, skip, c;
-    char read[LINE_MAX];
-    char *term, *filename;
-    FILE *file;
+    struct CacheEntry *formula;
+    struct Options o;
+    struct Bindings env;
+    struct Arena *arena;
+    long cache_size;
+    int i, k, count, threads;
+    char fromfile, fromstdin, value;
+    int c;
+    const char *term;
+    char *filename, *hidden, **args, **formulas;
+    size_t length;
+    struct Input *input;
 
-    filename = term = NULL;
-    fromfile = just_print = skip = 0;
-    i = 1;
-    precision = 5;
+    filename = NULL;
+    term = NULL;
+    input = NULL;
+    length = 0;
+    memset(&o, 0, sizeof(o));
+    fromfile = fromstdin = 0;
+    threads = 0;
+    cache_size = CACHE_SIZE;
+    o.precision = 5;
+    o.type = NUMBER_TYPE;
 
     /* no arguments */
     if (argc == 1) {
@@ -63,31 +323,122 @@ int main(int argc, char *argv[])
         return (0);
     }
 
+    args = malloc((argc + 1) * sizeof(char *));
+    formulas = malloc(argc * sizeof(char *));
+    hidden = calloc(argc, sizeof(char));
+
+    if (args == NULL || formulas == NULL || hidden == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    /* formulas like "-3+4" are hidden from getopt, values of options
+     * like "-C -1" are not */
+    args[0] = argv[0];
+    count = 1;
+    value = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!value && negative_formula(argv[i]))
+            hidden[i] = 1;
+        else
+            args[count++] = argv[i];
+
+        value = !value && !hidden[i] && value_follows(argv[i]);
+    }
+
+    args[count] = NULL;
+
     /* read arguments */
-    while ((c = getopt(argc, argv, "f:p:hn0123456789E^*/+-.?:()")) != -1) {
+    opterr = 0;
+
+    while ((c = getopt_long(count, args, OPTIONS, long_options,
+                            NULL)) != -1) {
         switch (c) {
             /* get file name */
         case 'f':
             filename = optarg;
             fromfile = 1;
+            fromstdin = (strcmp(optarg, "-") == 0);
             break;
 
         case 'n':
-            just_print = 1;
-            skip++;
+            o.just_print = 1;
+            break;
+
+        case 'J':
+            o.native = 1;
+            break;
+
+        case 'j':
+            threads = atoi(optarg);
+            break;
+
+        case 't':
+            if ((o.type = number_type(optarg)) == -1) {
+                fprintf(stderr, "unknown numeric type %s\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+
+            break;
+
+        case 'T':
+            if ((o.table = read_table(optarg)) == NULL)
+                exit(EXIT_FAILURE);
+
+            break;
+
+            /* fixed values of variables */
+        case 'D':
+            if (o.bindings == NULL)
+                o.bindings = new_bindings();
+
+            if (bind_variable(o.bindings, optarg) == -1)
+                exit(EXIT_FAILURE);
+
+            break;
+
+        case 'B':
+            if (o.bindings == NULL)
+                o.bindings = new_bindings();
+
+            if (read_bindings(o.bindings, optarg) == -1)
+                exit(EXIT_FAILURE);
+
+            break;
+
+        case 'C':
+            if ((cache_size = atol(optarg)) < 0)
+                cache_size = 0;
+
+            break;
+
+        case 'S':
+            o.statistics = 1;
+            break;
+
+        case 'H':
+            o.share = 1;
             break;
 
             /* get precision */
         case 'p':
-            precision = atoi(optarg);
+            o.precision = atoi(optarg);
 
-            if (precision < 0)
-                precision = 0;
+            if (o.precision < 0)
+                o.precision = 0;
 
-            if (precision > 65)
-                precision = 65;
+            if (o.precision > 65)
+                o.precision = 65;
+            break;
 
-            i = 3;
+        case '?':
+            if (optopt != 0)
+                fprintf(stderr, "%s: invalid option -- '%c'\n", argv[0],
+                        optopt);
+            else
+                fprintf(stderr, "%s: invalid option '%s'\n", argv[0],
+                        args[optind - 1]);
             break;
 
             /* print help */
@@ -98,69 +449,135 @@ int main(int argc, char *argv[])
         }
     }
 
+    /* getopt moved the other formulas to args[optind], they are taken
+     * in the order of argv */
+    for (i = 1, k = optind, c = 0; i < argc; i++)
+        if (hidden[i])
+            formulas[c++] = argv[i];
+        else if (k < count && args[k] == argv[i])
+            formulas[c++] = args[k++];
+
+    count = c;
+    free(hidden);
+    free(args);
+
+    o.print_term = !((argc == 2 && !fromfile) || o.just_print);
+
+    /* the workers of -j calculate a large tree alone, elsewhere it is
+     * split over THREADS or all processors */
+    set_task_threads((threads > 0) ? threads
+                     : (int) sysconf(_SC_NPROCESSORS_ONLN));
+    o.cache = new_cache((size_t) cache_size);
+
     if (fromfile) {
         /* open file */
-        if ((file = fopen(filename, "r")) == NULL) {
-            perror("fopen");
+        if ((input = open_input(filename)) == NULL)
             exit(EXIT_FAILURE);
+
+        /* the lines are calculated on several threads */
+        if (threads > 1) {
+            /* choose the kernels before the threads start */
+            batch_kernels();
+
+            process_lines(input, threads, calculate_line, &o);
+
+            close_input(input);
+            finish(&o);
+            free(formulas);
+            return (0);
         }
 
         /* empty file */
-        if (fgets(read, LINE_MAX - 1, file) == NULL) {
-            fclose(file);
+        if (!next_line(input, &term, &length)) {
+            close_input(input);
+            finish(&o);
+            free(formulas);
             return (0);
         }
     }
 
+    /* all nodes of one formula are freed at once */
+    arena = new_arena();
+    set_arena(arena);
+
+    i = 0;
+
     do {
-        if (fromfile) {
-            term = read;
-            term[strlen(term) - 1] = '\0';
-        } else
-            term = argv[i + skip];
+        reset_arena(arena);
 
-        if (term == NULL)
-            break;
+        if (!fromfile) {
+            if (i == count)
+                break;
+
+            term = formulas[i];
+            length = strlen(term);
+        }
 
         /* empty string */
-        if (strlen(term) == 0) {
+        if (length == 0) {
             i++;
             continue;
         }
 
-        /* create parse tree */
-        if ((parse_tree = parse(term)) == NULL) {
-            fprintf(stderr, "cannot create parse tree for %s\n", term);
-            i++;
-            continue;
-        } else {
-            reduce(parse_tree);
+        /* values of the variables, the tree is not changed */
+        if (o.bindings != NULL)
+            env = *o.bindings;
+        else
+            memset(&env, 0, sizeof(env));
 
-            /* replace variables of tree */
-            replace_variables(&parse_tree);
+        formula = find_formula(o.cache, term, length);
+
+        /* repeated formulas are not parsed again unless the user
+         * is asked for variables (the table has their values) */
+        if (formula == NULL || (o.table == NULL
+                                && missing_value(formula->program, &env))) {
+            /* create parse tree */
+            if ((parse_tree = parse_report(term, length, stdout)) == NULL) {
+                fprintf(stderr, "cannot create parse tree for %.*s\n",
+                        (int) length, term);
+                i++;
+                continue;
+            }
 
             reduce(parse_tree);
 
-            /* calculate value of parse tree */
-            result = calculate_parse_tree(parse_tree);
+            /* the answers cannot be read from the formulas */
+            if (o.table == NULL && fromstdin
+                && (c = unbound_variable(parse_tree, &env)) != 0) {
+                fflush(stdout);
+                fprintf(stderr, "no value for variable %c in %.*s "
+                        "(-f - needs -D or --bindings)\n", c,
+                        (int) length, term);
 
-            /* print result */
-            if ((argc == 2 && !fromfile) || just_print)
-                printf("%.*Lf\n", precision, result);
-            else
-                printf("%s = %.*Lf\n", term, precision, result);
+                if (formula != NULL)
+                    release_formula(o.cache, formula);
+
+                i++;
+                continue;
+            }
+
+            if (o.table == NULL)
+                ask_variables(parse_tree, &env);
 
-            /* free memory of parse tree */
-            delete_tree(parse_tree);
+            if (formula == NULL)
+                formula = compile_formula(term, length, parse_tree, &o);
         }
 
+        calculate(term, length, formula, &env, &o, stdout, stderr);
+        release_formula(o.cache, formula);
+
         i++;
-    } while (fromfile ? (fgets(read, LINE_MAX - 1, file) != NULL)
-             : (argv[i] != NULL));
+    } while (fromfile ? next_line(input, &term, &length) : (i < count));
+
+    set_arena(NULL);
+    delete_arena(arena);
+    free(formulas);
 
     /* close file */
     if (fromfile)
-        fclose(file);
+        close_input(input);
+
+    finish(&o);
 
     return (0);
 }
@@ -23,13 +23,37 @@
 #include <string.h>
 #include <stdio.h>
 
+#include "arena.h"
 #include "node.h"
 #include "list.h"
 
+/* arena for new nodes, NULL means malloc
+ * (every thread has its own) */
+static __thread struct Arena *arena = NULL;
+
+/* sets the arena that new nodes are allocated from
+ * 1. argument: pointer of the arena (NULL for malloc)
+ * return value: the arena used before */
+struct Arena *set_arena(struct Arena *a)
+{
+    struct Arena *old;
+
+    old = arena;
+    arena = a;
+
+    return (old);
+}
+
 struct Node *new_node(void)
 {
     struct Node *n;
 
+    if (arena != NULL) {
+        n = arena_alloc(arena, sizeof(struct Node));
+        n->in_arena = 1;
+        return (n);
+    }
+
     n = calloc(1, sizeof(struct Node));
 
     if (n == NULL) {
@@ -48,6 +72,7 @@ struct Node *new_operator_node(char op)
 
     n->type = OPERATOR;
     n->data.op.operator = atoo(op);
+    hash_node(n);
 
     return (n);
 }
@@ -60,11 +85,12 @@ struct Node *new_variable_node(char var)
 
     n->type = VARIABLE;
     n->data.name = var;
+    hash_node(n);
 
     return (n);
 }
 
-struct Node *new_number_node(double nr)
+struct Node *new_number_node(number nr)
 {
     struct Node *n;
 
@@ -72,6 +98,7 @@ struct Node *new_number_node(double nr)
 
     n->type = NUMBER;
     n->data.value = nr;
+    hash_node(n);
 
     return (n);
 }
@@ -87,13 +114,96 @@ struct Node *new_conditional_node(struct Node *condition,
     node->data.con.condition = condition;
     node->data.con.true = true;
     node->data.con.false = false;
+    condition->parent = true->parent = false->parent = node;
+    hash_node(node);
 
     return (node);
 }
 
+/* returns a child of a node by its index
+ * 1. argument: pointer of the node
+ * 2. argument: index of the child (left, right or condition, true, false)
+ * return value: the child or NULL after the last child */
+struct Node *child_node(struct Node *n, int i)
+{
+    switch (n->type) {
+    case OPERATOR:
+        if (i == 0)
+            return (n->data.op.left);
+
+        if (i == 1)
+            return (n->data.op.right);
+        break;
+
+    case CONDITIONAL:
+        if (i == 0)
+            return (n->data.con.condition);
+
+        if (i == 1)
+            return (n->data.con.true);
+
+        if (i == 2)
+            return (n->data.con.false);
+        break;
+    }
+
+    return (NULL);
+}
+
+/* starts an empty walk
+ * 1. argument: pointer of the walk
+ * return value: none */
+void init_walk(struct Walk *w)
+{
+    w->step = w->small;
+    w->count = 0;
+    w->size = WALK_INLINE;
+}
+
+/* goes down to a node, it becomes the current step with state 0
+ * 1. argument: pointer of the walk
+ * 2. argument: pointer of the node
+ * return value: none */
+void enter_node(struct Walk *w, struct Node *n)
+{
+    struct Step *step;
+
+    /* the array is doubled when it is full */
+    if (w->count == w->size) {
+        if ((step = malloc(2 * w->size * sizeof(struct Step))) == NULL) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(step, w->step, w->count * sizeof(struct Step));
+
+        if (w->step != w->small)
+            free(w->step);
+
+        w->step = step;
+        w->size *= 2;
+    }
+
+    w->step[w->count].node = n;
+    w->step[w->count].state = 0;
+    w->count++;
+}
+
+/* frees the memory of a walk
+ * 1. argument: pointer of the walk
+ * return value: none */
+void free_walk(struct Walk *w)
+{
+    if (w->step != w->small)
+        free(w->step);
+
+    init_walk(w);
+}
+
 void delete_node(struct Node *old)
 {
-    if (old == NULL)
+    /* nodes of an arena are freed with the arena */
+    if (old == NULL || old->in_arena)
         return;
 
     free(old->formula);
@@ -102,28 +212,31 @@ void delete_node(struct Node *old)
 
 void delete_tree(struct Node *old)
 {
-    if (old == NULL)
+    struct List stack;
+    struct Node *child;
+    int i;
+
+    if (old == NULL || old->in_arena)
         return;
 
-    switch (old->type) {
-    case OPERATOR:
-        delete_tree(old->data.op.left);
-        delete_tree(old->data.op.right);
-        break;
+    /* the order of deleting does not matter */
+    init_list(&stack);
+    add_node(&stack, old);
 
-    case CONDITIONAL:
-        delete_tree(old->data.con.condition);
-        delete_tree(old->data.con.true);
-        delete_tree(old->data.con.false);
-        break;
+    while (stack.count > 0) {
+        old = stack.node[--stack.count];
 
-    case ERROR:
-        fprintf(stderr, "ERROR\n");
-        break;
+        for (i = 0; (child = child_node(old, i)) != NULL; i++)
+            if (!child->in_arena)
+                add_node(&stack, child);
+
+        if (old->type == ERROR)
+            fprintf(stderr, "ERROR\n");
+
+        delete_node(old);
     }
 
-    /* leaf */
-    delete_node(old);
+    free_list(&stack);
 }
 
 struct Node *set_childs(struct Node *root, struct Node *left,
@@ -132,11 +245,55 @@ struct Node *set_childs(struct Node *root, struct Node *left,
     if (root->type == OPERATOR) {
         root->data.op.left = left;
         root->data.op.right = right;
+
+        if (left != NULL)
+            left->parent = root;
+
+        if (right != NULL)
+            right->parent = root;
+
+        hash_node(root);
     }
 
     return (root);
 }
 
+/* moves the content of a node into a node that keeps its place in the
+ * tree (like "0+a" becomes "a"), the children follow the content and
+ * the emptied node can be deleted on its own
+ * 1. argument: node that receives the content
+ * 2. argument: node that gives the content
+ * return value: none */
+void move_node(struct Node *to, struct Node *from)
+{
+    struct Node *parent;
+
+    parent = to->parent;
+
+    /* the formula follows the content too */
+    if (to->formula != NULL && !to->in_arena)
+        free(to->formula);
+
+    memcpy(to, from, sizeof(struct Node));
+    to->parent = parent;
+
+    switch (to->type) {
+    case OPERATOR:
+        to->data.op.left->parent = to;
+        to->data.op.right->parent = to;
+        break;
+
+    case CONDITIONAL:
+        to->data.con.condition->parent = to;
+        to->data.con.true->parent = to;
+        to->data.con.false->parent = to;
+        break;
+    }
+
+    from->type = NUMBER;
+    from->formula = NULL;
+}
+
 char otoa(int operator)
 {
     switch (operator) {
@@ -230,7 +387,7 @@ void print_node(struct Node *root)
         break;
 
     case NUMBER:
-        printf("%.2Lf", root->data.value);
+        print_number(stdout, 2, root->data.value);
         break;
 
     case VARIABLE:
@@ -239,11 +396,11 @@ void print_node(struct Node *root)
     }
 }
 
-void print_tree(struct Node *root)
+/* prints a node of print_tree() and its children
+ * 1. argument: pointer of the node
+ * return value: none */
+static void print_step(struct Node *root)
 {
-    if (root == NULL)
-        return;
-
     switch (root->type) {
     case CONDITIONAL:
         printf("? ");
@@ -257,9 +414,6 @@ void print_tree(struct Node *root)
         break;
 
     case OPERATOR:
-        print_tree(root->data.op.left);
-        print_tree(root->data.op.right);
-
         switch (root->data.op.operator) {
         case ADD:
             printf("+ ");
@@ -318,7 +472,8 @@ void print_tree(struct Node *root)
         break;
 
     case NUMBER:
-        printf("%Lf\n", root->data.value);
+        print_number(stdout, 6, root->data.value);
+        printf("\n");
         break;
 
     case VARIABLE:
@@ -331,226 +486,215 @@ void print_tree(struct Node *root)
     }
 }
 
-static long double my_fabs(long double d)
-{
-    return ((d < 0) ? (-d) : (d));
-}
-
-static char *ldtostr(long double d)
+/* prints the operators of a tree after their operands
+ * 1. argument: pointer of the tree
+ * return value: none */
+void print_tree(struct Node *root)
 {
-    unsigned int digits;
-    char *ret;
-    long double h;
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
 
-    if (d == HUGE_VAL || d == -HUGE_VAL)
-        return (strdup("inf"));
+    if (root == NULL)
+        return;
 
-    if (d == 0.0)
-        digits = 1;
-    else
-        digits = 0;
+    init_walk(&w);
+    enter_node(&w, root);
 
-    if (d < 0)
-        digits++;
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-    for (h = d; my_fabs(h) > 0.0; h /= 10.0)
-        digits++;
+        /* the children of a conditional are printed with it */
+        if (step->node->type == OPERATOR
+            && (child = child_node(step->node, step->state++)) != NULL) {
+            enter_node(&w, child);
+            continue;
+        }
 
-    /* digit-characters '.' precision-characters '\0' */
-    if ((ret = calloc(digits + 1 + 65 + 1, sizeof(char))) == NULL) {
-        perror("calloc");
-        exit(EXIT_FAILURE);
+        print_step(step->node);
+        w.count--;
     }
 
-    sprintf(ret, "%.65Lf", d);
-
-    return (ret);
+    free_walk(&w);
 }
 
-char *get_formula(struct Node *root)
+/* decimals of the numbers in a formula */
+#define FORMULA_PRECISION 65
+
+/* a subtree needs braces if it has another operator than its parent */
+#define NEEDS_BRACES(parent, child) \
+    ((child)->type == OPERATOR \
+     && (child)->data.op.operator != (parent)->data.op.operator)
+
+/* an operator or conditional is written in parts around its children
+ * like "(" left ")+(" right ")"
+ * 1. argument: pointer of the node
+ * 2. argument: index of the part
+ * 3. argument: string that receives the part (4 characters)
+ * return value: the child after the part or NULL after the last part */
+static struct Node *formula_part(struct Node *root, int i, char *text)
 {
-    static int f = 0;
-    static char *formula = NULL;
-    char temp[2];
-    char *h;
+    static const char *conditional[] = { "(", ")?(", "):(", ")" };
+    struct Node *child;
 
-    if (root == NULL) {
-        return (NULL);
-    }
+    *text = '\0';
 
-    if (f == 0 && (formula = calloc(1, sizeof(char))) == NULL) {
-        perror("calloc");
-        exit(EXIT_FAILURE);
+    if (root->type == CONDITIONAL) {
+        strcpy(text, conditional[i]);
+        return (child_node(root, i));
     }
 
-    f++;
-
-    switch (root->type) {
-    case CONDITIONAL:
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
-
-        strcat(formula, "(");
-        get_formula(root->data.con.condition);
-
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
-
-        strcat(formula, ")?(");
-        get_formula(root->data.con.true);
+    if (i > 0 && NEEDS_BRACES(root, child_node(root, i - 1)))
+        *text++ = ')';
 
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
+    if (i == 1)
+        *text++ = otoa(root->data.op.operator);
 
-        strcat(formula, "):(");
-        get_formula(root->data.con.false);
+    if ((child = child_node(root, i)) != NULL && NEEDS_BRACES(root, child))
+        *text++ = '(';
 
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
+    *text = '\0';
 
-        strcat(formula, ")");
-        break;
-
-    case OPERATOR:
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator != root->data.op.
-            operator) {
-            if ((formula =
-                 realloc(formula,
-                         (strlen(formula) + 2) * sizeof(char))) == NULL) {
-                perror("realloc");
-                exit(EXIT_FAILURE);
-            }
-
-            strcat(formula, "(");
-        }
+    return (child);
+}
 
-        get_formula(root->data.op.left);
+/* operators and conditionals are written in parts (see formula_part) */
+#define HAS_PARTS(node) \
+    ((node)->type == OPERATOR || (node)->type == CONDITIONAL)
 
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator != root->data.op.
-            operator) {
-            if ((formula =
-                 realloc(formula,
-                         (strlen(formula) + 2) * sizeof(char))) == NULL) {
-                perror("realloc");
-                exit(EXIT_FAILURE);
+/* measures the formula of a tree
+ * 1. argument: pointer of the tree
+ * return value: number of characters without the '\0' */
+static size_t formula_length(struct Node *root)
+{
+    struct List stack;
+    struct Node *child;
+    size_t length;
+    char text[4];
+    int i;
+
+    length = 0;
+
+    /* the order of the parts does not matter for the length */
+    init_list(&stack);
+    add_node(&stack, root);
+
+    while (stack.count > 0) {
+        root = stack.node[--stack.count];
+
+        switch (root->type) {
+        case CONDITIONAL:
+        case OPERATOR:
+            for (i = 0; (child = formula_part(root, i, text)) != NULL; i++) {
+                length += strlen(text);
+                add_node(&stack, child);
             }
 
-            strcat(formula, ")");
-        }
+            length += strlen(text);
+            break;
 
-        sprintf(temp, "%c", otoa(root->data.op.operator));
-        temp[1] = '\0';
+        case NUMBER:
+            length += format_number(NULL, 0, FORMULA_PRECISION,
+                                    root->data.value);
+            break;
 
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
+        case VARIABLE:
+        case E_SYMBOL:
+            length++;
+            break;
         }
+    }
 
-        strcat(formula, temp);
+    free_list(&stack);
 
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator != root->data.op.
-            operator) {
-            if ((formula =
-                 realloc(formula,
-                         (strlen(formula) + 2) * sizeof(char))) == NULL) {
-                perror("realloc");
-                exit(EXIT_FAILURE);
-            }
+    return (length);
+}
 
-            strcat(formula, "(");
+/* writes the formula of a tree into a string that was measured
+ * with formula_length()
+ * 1. argument: the string
+ * 2. argument: end of the string (place of the '\0')
+ * 3. argument: pointer of the tree
+ * return value: end of the written formula */
+static char *put_formula(char *s, char *end, struct Node *root)
+{
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+    char text[4];
+    size_t n;
+
+    init_walk(&w);
+    enter_node(&w, root);
+
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
+
+        if (HAS_PARTS(root)) {
+            child = formula_part(root, step->state++, text);
+            n = strlen(text);
+            memcpy(s, text, n);
+            s += n;
+
+            if (child != NULL)
+                enter_node(&w, child);
+            else
+                w.count--;
+
+            continue;
         }
 
-        get_formula(root->data.op.right);
-
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator != root->data.op.
-            operator) {
-            if ((formula =
-                 realloc(formula,
-                         (strlen(formula) + 2) * sizeof(char))) == NULL) {
-                perror("realloc");
-                exit(EXIT_FAILURE);
-            }
+        switch (root->type) {
+        case NUMBER:
+            /* the '\0' of the number is overwritten by the next character */
+            s += format_number(s, end - s + 1, FORMULA_PRECISION,
+                               root->data.value);
+            break;
 
-            strcat(formula, ")");
-        }
-        break;
+        case VARIABLE:
+            *s++ = root->data.name;
+            break;
 
-    case NUMBER:
-        h = ldtostr(root->data.value);
+        case E_SYMBOL:
+            *s++ = 'E';
+            break;
 
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + strlen(h) + 1) * sizeof(char))) ==
-            NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
+        default:
+            fprintf(stderr, "ERROR\n");
+            break;
         }
 
-        strcat(formula, h);
+        w.count--;
+    }
 
-        free(h);
-        break;
+    free_walk(&w);
 
-    case VARIABLE:
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
+    return (s);
+}
 
-        sprintf(temp, "%c", root->data.name);
-        temp[1] = '\0';
-        strcat(formula, temp);
-        break;
+/* creates the formula of a tree, the string is measured before it is
+ * written in one pass
+ * 1. argument: pointer of the tree
+ * return value: the formula (must be freed by the caller) */
+char *get_formula(struct Node *root)
+{
+    char *s;
+    size_t length;
 
-    case E_SYMBOL:
-        if ((formula =
-             realloc(formula,
-                     (strlen(formula) + 2) * sizeof(char))) == NULL) {
-            perror("realloc");
-            exit(EXIT_FAILURE);
-        }
+    if (root == NULL)
+        return (NULL);
 
-        sprintf(temp, "E");
-        temp[1] = '\0';
-        strcat(formula, temp);
-        break;
+    length = formula_length(root);
 
-    default:
-        fprintf(stderr, "ERROR\n");
-        break;
+    if ((s = malloc(length + 1)) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
     }
 
-    f--;
+    *put_formula(s, s + length, root) = '\0';
 
-    if (f == 0) {
-        return (formula);
-    }
-
-    return (NULL);
+    return (s);
 }
 
 int cmp_nodes(struct Node *n1, struct Node *n2)
@@ -574,433 +718,692 @@ int cmp_nodes(struct Node *n1, struct Node *n2)
     return (0);
 }
 
+/* returns the parent of a node inside a tree
+ * 1. argument: pointer of the tree
+ * 2. argument: pointer of the node
+ * return value: the parent or NULL for the root of the tree */
 struct Node *get_parent(struct Node *root, struct Node *search)
 {
-    struct Node *parent;
-
-    if (root == NULL)
+    if (search == NULL || search == root)
         return (NULL);
 
-    switch (root->type) {
-    case OPERATOR:
-        if ((parent = get_parent(root->data.op.left, search)) != NULL
-            || (parent = get_parent(root->data.op.right, search)) != NULL)
-            return (parent);
+    return (search->parent);
+}
 
-        if (root->data.op.left == search || root->data.op.right == search)
-            return (root);
+/* mixes a value into a hash */
+#define MIX(h, v) (((h) ^ (uint64_t) (v)) * 0x9e3779b97f4a7c15ULL)
+
+/* 0 and -0 differ */
+#define SAME_NUMBER(x, y) ((x) == (y) && ((x) != 0 || 1 / (x) == 1 / (y)))
+
+/* adds a child to the summary of a node
+ * 1. argument: pointer of the node
+ * 2. argument: pointer of the child
+ * return value: none */
+static void add_summary(struct Node *n, struct Node *child)
+{
+    if (child == NULL)
+        return;
+
+    n->variables |= child->variables;
+    n->size += child->size;
+
+    if (child->depth + 1 > n->depth)
+        n->depth = child->depth + 1;
+}
+
+/* calculates the hash of a node from the hashes of its children,
+ * the variables, size and depth of the subtree are summed up too
+ * 1. argument: pointer of the node
+ * return value: none */
+void hash_node(struct Node *n)
+{
+    uint64_t h, bits;
+    double d;
+
+    h = (uint64_t) n->type + 1;
+
+    n->variables = 0;
+    n->size = 1;
+    n->depth = 1;
+
+    switch (n->type) {
+    case NUMBER:
+        /* equal values are equal doubles, the bits of a wider number
+         * that do not fit are hashed as a second double */
+        d = (double) n->data.value;
+        memcpy(&bits, &d, sizeof(bits));
+        h = MIX(h, bits);
+
+        if (isfinite(d)) {
+            d = (double) (n->data.value - (number) d);
+            memcpy(&bits, &d, sizeof(bits));
+            h = MIX(h, bits);
+        }
+        break;
+
+    case VARIABLE:
+        h = MIX(h, n->data.name);
+        n->variables = VARIABLE_BIT(n->data.name);
+        break;
+
+    case OPERATOR:
+        h = MIX(h, n->data.op.operator);
+        h = MIX(h, n->data.op.left ? n->data.op.left->hash : 0);
+        h = MIX(h, n->data.op.right ? n->data.op.right->hash : 0);
+        add_summary(n, n->data.op.left);
+        add_summary(n, n->data.op.right);
         break;
 
     case CONDITIONAL:
-        if ((parent = get_parent(root->data.con.condition, search)) != NULL
-            || (parent = get_parent(root->data.con.true, search)) != NULL
-            || (parent =
-                get_parent(root->data.con.false, search)) != NULL) {
-            return (parent);
-        }
-        if (root->data.con.condition == search
-            || root->data.con.true == search
-            || root->data.con.false == search) {
-            return (root);
-        }
+        h = MIX(h, n->data.con.condition->hash);
+        h = MIX(h, n->data.con.true->hash);
+        h = MIX(h, n->data.con.false->hash);
+        add_summary(n, n->data.con.condition);
+        add_summary(n, n->data.con.true);
+        add_summary(n, n->data.con.false);
         break;
     }
 
-    return (NULL);
+    h ^= h >> 29;
+    n->hash = h;
 }
 
-int cmp_trees(struct Node *a, struct Node *b)
+/* calculates the hashes of a chain of one operator like "a+b+c"
+ * and of the numbers and variables in it
+ * 1. argument: pointer of the chain
+ * 2. argument: the operator
+ * return value: none */
+void hash_chain(struct Node *root, int operator)
 {
-    int ret;
-    char *f, *g;
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+
+    init_walk(&w);
+    enter_node(&w, root);
 
-    f = get_formula(a);
-    g = get_formula(b);
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-    ret = strcmp(f, g);
+        /* only the nodes of the chain are followed */
+        if (IN_CHAIN(step->node, operator)
+            && (child = child_node(step->node, step->state++)) != NULL) {
+            enter_node(&w, child);
+            continue;
+        }
 
-    free(f);
-    free(g);
+        if (IN_CHAIN(step->node, operator)
+            || step->node->type == NUMBER || step->node->type == VARIABLE)
+            hash_node(step->node);
 
-    return (!ret);
+        w.count--;
+    }
+
+    free_walk(&w);
 }
 
-static void sort_numbers(struct List *l)
+/* compares two trees, the hashes are compared first
+ * 1. argument: pointer of the first tree
+ * 2. argument: pointer of the second tree
+ * return value: 1 if the trees are equal, 0 if not */
+int cmp_trees(struct Node *a, struct Node *b)
 {
-    struct Element *current, *current2;
-    long double temp;
+    struct List stack;
+    int i, equal;
 
-    current = l->first;
+    /* a shared subtree */
+    if (a == b)
+        return (1);
 
-    while (current != NULL) {
-        current2 = current->next;
+    if (a->hash != b->hash || a->type != b->type)
+        return (0);
 
-        while (current2 != NULL) {
-            if (current2->node->data.value < current->node->data.value) {
-                temp = current2->node->data.value;
-                current2->node->data.value = current->node->data.value;
-                current->node->data.value = temp;
-            }
+    /* pairs of subtrees that are compared yet */
+    init_list(&stack);
+    add_node(&stack, a);
+    add_node(&stack, b);
+    equal = 1;
+
+    while (equal && stack.count > 0) {
+        b = stack.node[--stack.count];
+        a = stack.node[--stack.count];
+
+        if (a == b)
+            continue;
 
-            current2 = current2->next;
+        if (a->hash != b->hash || a->type != b->type) {
+            equal = 0;
+            break;
         }
 
-        current = current->next;
+        switch (a->type) {
+        case NUMBER:
+            equal = SAME_NUMBER(a->data.value, b->data.value);
+            break;
+
+        case VARIABLE:
+            equal = (a->data.name == b->data.name);
+            break;
+
+        case OPERATOR:
+            if (a->data.op.operator != b->data.op.operator) {
+                equal = 0;
+                break;
+            }
+
+            /* fall through */
+        case CONDITIONAL:
+            /* the left subtrees are compared first */
+            for (i = (a->type == OPERATOR ? 1 : 2); i >= 0; i--) {
+                add_node(&stack, child_node(a, i));
+                add_node(&stack, child_node(b, i));
+            }
+            break;
+
+        default:
+            equal = 0;
+            break;
+        }
     }
+
+    free_list(&stack);
+
+    return (equal);
 }
 
-static void sort_variables(struct List *l)
+/* the canonical order of the operands of a chain like "c+a+2":
+ * numbers by their value, variables by their name, operators by their
+ * operator and conditionals, trees that differ only in the order of
+ * their operands get the same order through their hashes
+ * 1. argument: pointer of the first node
+ * 2. argument: pointer of the second node
+ * return value: negative, zero or positive */
+static int cmp_operands(struct Node *a, struct Node *b)
 {
-    struct Element *current, *current2;
-    char temp;
+    /* rank of the node types in the chain */
+    static const int rank[] = { 2, 0, 1, 3 };
 
-    current = l->first;
+    if (a->type != b->type)
+        return (rank[a->type] - rank[b->type]);
 
-    while (current != NULL) {
-        current2 = current->next;
+    switch (a->type) {
+    case NUMBER:
+        if (a->data.value < b->data.value)
+            return (-1);
 
-        while (current2 != NULL) {
-            if (current2->node->data.name < current->node->data.name) {
-                temp = current2->node->data.name;
-                current2->node->data.name = current->node->data.name;
-                current->node->data.name = temp;
-            }
+        if (a->data.value > b->data.value)
+            return (1);
 
-            current2 = current2->next;
-        }
+        /* not a number comes last */
+        return ((a->data.value != a->data.value)
+                - (b->data.value != b->data.value));
+
+    case VARIABLE:
+        return (a->data.name - b->data.name);
+
+    case OPERATOR:
+        if (a->data.op.operator != b->data.op.operator)
+            return (a->data.op.operator - b->data.op.operator);
+        break;
+    }
+
+    if (a->hash != b->hash)
+        return (a->hash < b->hash ? -1 : 1);
+
+    return (0);
+}
+
+/* the places of the operands of a node of a chain like "a+b+c" in the
+ * order they are collected (see get_operands), a place that holds
+ * another node of the chain is walked through
+ * 1. argument: pointer of the node
+ * 2. argument: the operator of the chain
+ * 3. argument: index of the place (0 or 1)
+ * return value: address of the child in the node */
+static struct Node **chain_place(struct Node *root, int operator, int i)
+{
+    /* a chain on the right side comes first if the left side is none */
+    if (IN_CHAIN(root->data.op.right, operator)
+        && !IN_CHAIN(root->data.op.left, operator))
+        i = !i;
+
+    return (i == 0 ? &root->data.op.left : &root->data.op.right);
+}
 
-        current = current->next;
+/* takes the next node of a list
+ * 1. argument: pointer of the list
+ * 2. argument: index of the next node, it is incremented
+ * return value: pointer of the node */
+static struct Node *take_node(struct List *l, unsigned int *next)
+{
+    if (*next >= l->count) {
+        fprintf(stderr, "ERROR\n");
+        exit(EXIT_FAILURE);
     }
+
+    return (l->node[(*next)++]);
 }
 
-static void sort_operators(struct List *l)
+static void sort(struct Node *root, struct List *l, unsigned int *next,
+                 int operator)
 {
-    struct Element *current, *current2;
-    struct Node *temp;
+    struct Walk w;
+    struct Step *step;
+    struct Node **place;
 
-    temp = new_operator_node('#');
+    if (root == NULL || !IN_CHAIN(root, operator))
+        return;
 
-    current = l->first;
+    init_walk(&w);
+    enter_node(&w, root);
 
-    while (current != NULL) {
-        current2 = current->next;
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-        while (current2 != NULL) {
-            if (current2->node->data.op.operator < current->node->data.op.
-                operator) {
-                memcpy(temp, current->node, sizeof(struct Node));
-                memcpy(current->node, current2->node, sizeof(struct Node));
-                memcpy(current2->node, temp, sizeof(struct Node));
-            }
+        if (step->state == 2) {
+            w.count--;
+            continue;
+        }
+
+        place = chain_place(step->node, operator, step->state++);
 
-            current2 = current2->next;
+        if (IN_CHAIN(*place, operator)) {
+            enter_node(&w, *place);
+            continue;
         }
 
-        current = current->next;
+        *place = take_node(l, next);
+        (*place)->parent = step->node;
     }
 
-    delete_node(temp);
+    free_walk(&w);
 }
 
-static void sort_conditional(struct List *l)
+/* sorts the operands of a chain of one operator like "c+a+2", the
+ * operands must have their hashes (see sort_tree)
+ * 1. argument: pointer of the chain
+ * return value: none */
+static void sort_operands(struct Node *root)
 {
-    /* no idea */
+    struct List operands;
+    unsigned int i;
+
+    init_list(&operands);
+
+    if (get_operands(root, root->data.op.operator, &operands) == 0) {
+        fprintf(stderr, "ERROR\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sort_list(&operands, cmp_operands);
+
+    i = 0;
+    sort(root, &operands, &i, root->data.op.operator);
+
+    free_list(&operands);
 }
 
-static void sort(struct Node *root, struct List *l, int operator)
+/* brings the operands of all chains of "+" and "*" into their canonical
+ * order, afterwards every node of the tree has its hash
+ * 1. argument: pointer of the tree
+ * return value: none */
+void sort_tree(struct Node *root)
 {
-    if (root == NULL) {
-        return;
-    }
+    struct Walk w;
+    struct Step *step;
+    struct Node *n, *child;
 
-    if (root->type == OPERATOR && root->data.op.operator == operator) {
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator == operator
-            && root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator == operator) {
-            sort(root->data.op.left, l, operator);
-            sort(root->data.op.right, l, operator);
-            return;
-        }
+    /* subtrees without variables are calculated by reduce() */
+    if (root->variables == 0)
+        return;
 
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator == operator) {
-            sort(root->data.op.right, l, operator);
+    init_walk(&w);
+    enter_node(&w, root);
 
-            if (l->current == NULL) {
-                fprintf(stderr, "ERROR\n");
-                exit(EXIT_FAILURE);
-            }
+    /* the operands of a node are sorted before the node */
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        n = step->node;
 
-            root->data.op.left = l->current->node;
-            next_element(l);
+        if ((child = child_node(n, step->state++)) != NULL) {
+            if (child->variables != 0)
+                enter_node(&w, child);
 
-            return;
+            continue;
         }
 
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator == operator) {
-            sort(root->data.op.left, l, operator);
+        w.count--;
 
-            if (l->current == NULL) {
-                fprintf(stderr, "ERROR\n");
-                exit(EXIT_FAILURE);
-            }
+        if (n->type == CONDITIONAL) {
+            hash_node(n);
+            continue;
+        }
 
-            root->data.op.right = l->current->node;
-            next_element(l);
+        if (n->type != OPERATOR)
+            continue;
 
-            return;
+        if (n->data.op.operator == MINUS
+            || n->data.op.operator == DIVIDE
+            || n->data.op.operator == POWER
+            || n->data.op.operator == E_SYMBOL) {
+            hash_node(n);
+            continue;           /* do not sort */
         }
 
-        root->data.op.left = l->current->node;
-        next_element(l);
+        /* a chain is sorted at its top */
+        if (n != root && IN_CHAIN(n->parent, n->data.op.operator))
+            continue;
 
-        if (l->current == NULL) {
-            fprintf(stderr, "ERROR\n");
-            exit(EXIT_FAILURE);
-        }
+        sort_operands(n);
 
-        root->data.op.right = l->current->node;
-        next_element(l);
+        /* the operands moved */
+        hash_chain(n, n->data.op.operator);
     }
+
+    free_walk(&w);
 }
 
-void sort_tree(struct Node *root)
+/* the distinct nodes of a tree, open addressing */
+struct Shared {
+    struct Node **node;
+    size_t size;
+};
+
+/* compares two nodes whose children are shared already
+ * return value: 1 if they have the same value, 0 if not */
+static int same_node(struct Node *a, struct Node *b)
 {
-    struct List *variables, *operators, *numbers,
-        *operands, *sorted, *conditional;
+    if (a->type != b->type)
+        return (0);
 
-    operands = NULL;
+    switch (a->type) {
+    case NUMBER:
+        return (SAME_NUMBER(a->data.value, b->data.value));
 
-    switch (root->type) {
-    case CONDITIONAL:
-        sort_tree(root->data.con.condition);
-        sort_tree(root->data.con.true);
-        sort_tree(root->data.con.false);
-        break;
+    case VARIABLE:
+        return (a->data.name == b->data.name);
 
     case OPERATOR:
-        sort_tree(root->data.op.left);
-        sort_tree(root->data.op.right);
+        return (a->data.op.operator == b->data.op.operator
+                && a->data.op.left == b->data.op.left
+                && a->data.op.right == b->data.op.right);
 
-        if (root->data.op.operator == MINUS
-            || root->data.op.operator == DIVIDE
-            || root->data.op.operator == POWER
-            || root->data.op.operator == E_SYMBOL)
-            return;             /* do not sort */
+    case CONDITIONAL:
+        return (a->data.con.condition == b->data.con.condition
+                && a->data.con.true == b->data.con.true
+                && a->data.con.false == b->data.con.false);
+    }
 
-        variables = new_list();
-        operators = new_list();
-        numbers = new_list();
-        conditional = new_list();
-        sorted = new_list();
+    return (0);
+}
 
-        operands = get_operands(root, root->data.op.operator);
+/* replaces a node whose children are shared already by the first
+ * node with the same value
+ * 1. argument: pointer of the node
+ * 2. argument: the distinct nodes seen so far
+ * return value: the node that is used in its place */
+static struct Node *share_node(struct Node *root, struct Shared *s)
+{
+    struct Node **slot;
+    size_t i;
 
-        if (operands == NULL) {
-            fprintf(stderr, "ERROR\n");
-            exit(EXIT_FAILURE);
-        }
+    hash_node(root);
 
-        rewind_list(operands);
+    for (i = root->hash & (s->size - 1);; i = (i + 1) & (s->size - 1)) {
+        slot = &s->node[i];
 
-        while (operands->current != NULL) {
-            if (operands->current->node->type == NUMBER)
-                add_node(numbers, operands->current->node);
+        if (*slot == NULL) {
+            *slot = root;
+            return (root);
+        }
 
-            if (operands->current->node->type == VARIABLE)
-                add_node(variables, operands->current->node);
+        if ((*slot)->hash == root->hash && same_node(*slot, root))
+            break;
+    }
 
-            if (operands->current->node->type == OPERATOR)
-                add_node(operators, operands->current->node);
+    /* calculating a leaf again is as fast as keeping its value */
+    if ((*slot)->type == OPERATOR || (*slot)->type == CONDITIONAL)
+        (*slot)->shared = 1;
 
-            if (operands->current->node->type == CONDITIONAL)
-                add_node(conditional, operands->current->node);
+    return (*slot);
+}
 
-            next_element(operands);
-        }
+/* replaces the children of every node by their shared nodes, the
+ * children are shared before their parent
+ * 1. argument: pointer of the tree
+ * 2. argument: the distinct nodes seen so far
+ * return value: none */
+static void share_nodes(struct Node *root, struct Shared *s)
+{
+    struct Walk w;
+    struct Step *step;
+    struct Node *n, *child;
 
-        sort_numbers(numbers);
-        sort_variables(variables);
-        sort_operators(operators);
-        sort_conditional(conditional);
+    init_walk(&w);
+    enter_node(&w, root);
 
-        while (numbers->current != NULL) {
-            add_node(sorted, numbers->current->node);
-            next_element(numbers);
-        }
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-        while (variables->current != NULL) {
-            add_node(sorted, variables->current->node);
-            next_element(variables);
+        if ((child = child_node(step->node, step->state++)) != NULL) {
+            enter_node(&w, child);
+            continue;
         }
 
-        while (operators->current != NULL) {
-            add_node(sorted, operators->current->node);
-            next_element(operators);
-        }
+        n = share_node(step->node, s);
+        w.count--;
 
-        while (conditional->current != NULL) {
-            add_node(sorted, conditional->current->node);
-            next_element(conditional);
-        }
+        if (w.count == 0)
+            break;
 
-        rewind_list(sorted);
-        sort(root, sorted, root->data.op.operator);
+        /* the parent replaces the child it just left */
+        step = TOP_STEP(&w);
 
-        delete_list_without_nodes(variables);
-        delete_list_without_nodes(operators);
-        delete_list_without_nodes(numbers);
-        delete_list_without_nodes(operands);
-        delete_list_without_nodes(conditional);
-        delete_list_without_nodes(sorted);
-        break;
+        switch (step->state - 1) {
+        case 0:
+            if (step->node->type == OPERATOR)
+                step->node->data.op.left = n;
+            else
+                step->node->data.con.condition = n;
+            break;
+
+        case 1:
+            if (step->node->type == OPERATOR)
+                step->node->data.op.right = n;
+            else
+                step->node->data.con.true = n;
+            break;
+
+        case 2:
+            step->node->data.con.false = n;
+            break;
+        }
     }
+
+    free_walk(&w);
 }
 
-void update(struct Node *root)
+/* turns a reduced tree into a graph where equal subtrees are one node,
+ * so "(a+b)*(a+b)" has one "a+b" that is calculated once
+ * (only trees of an arena are shared, the nodes that are not used
+ * anymore are freed with the arena; the tree must not be changed
+ * afterwards)
+ * 1. argument: pointer of the tree
+ * return value: none */
+void share_tree(struct Node *root)
 {
-    if (root == NULL)
+    struct Shared s;
+    size_t count;
+
+    if (root == NULL || !root->in_arena)
         return;
 
-    switch (root->type) {
-    case CONDITIONAL:
-        update(root->data.con.condition);
-        update(root->data.con.true);
-        update(root->data.con.false);
+    count = root->size;
 
-        if (root->formula != NULL)
-            free(root->formula);
+    /* at most every second slot is used */
+    for (s.size = 1; s.size < 2 * count; s.size *= 2);
 
-        root->formula = get_formula(root);
-        break;
+    if ((s.node = calloc(s.size, sizeof(struct Node *))) == NULL) {
+        perror("calloc(shared nodes)");
+        exit(EXIT_FAILURE);
+    }
 
-    case OPERATOR:
-        update(root->data.op.left);
-        update(root->data.op.right);
+    share_nodes(root, &s);
+
+    free(s.node);
+}
 
-        if (root->formula != NULL)
-            free(root->formula);
+static void set_formula(struct Node *root)
+{
+    char *f;
 
-        root->formula = get_formula(root);
-        break;
-    }
+    if (root->formula != NULL && !root->in_arena)
+        free(root->formula);
+
+    root->formula = NULL;
+    f = get_formula(root);
+
+    if (root->in_arena && arena != NULL) {
+        root->formula = arena_strdup(arena, f);
+        free(f);
+    } else
+        root->formula = f;
 }
 
-void print_formula(struct Node *root, int precision)
+/* creates the formulas of all subtrees of a tree
+ * 1. argument: pointer of the tree
+ * return value: none */
+void update(struct Node *root)
 {
-    static int f = 0;
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
 
     if (root == NULL)
         return;
 
-    f++;
+    init_walk(&w);
+    enter_node(&w, root);
 
-    switch (root->type) {
-    case CONDITIONAL:
-        printf("(");
-        print_formula(root->data.con.condition, precision);
-        printf(")?(");
-        print_formula(root->data.con.true, precision);
-        printf("):(");
-        print_formula(root->data.con.false, precision);
-        printf(")");
-        break;
+    /* the formulas of the children are made first */
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-    case OPERATOR:
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator != root->data.op.
-            operator)
-            printf("(");
+        if ((child = child_node(step->node, step->state++)) != NULL) {
+            enter_node(&w, child);
+            continue;
+        }
 
-        print_formula(root->data.op.left, precision);
+        if (HAS_PARTS(step->node))
+            set_formula(step->node);
 
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator != root->data.op.
-            operator)
-            printf(")");
+        w.count--;
+    }
 
-        printf("%c", otoa(root->data.op.operator));
+    free_walk(&w);
+}
 
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator != root->data.op.
-            operator)
-            printf("(");
+/* writes the formula of a tree to a file
+ * 1. argument: the file
+ * 2. argument: pointer of the tree
+ * 3. argument: precision of the numbers
+ * return value: none */
+void write_formula(FILE *f, struct Node *root, int precision)
+{
+    struct Walk w;
+    struct Step *step;
+    struct Node *child;
+    char text[4];
 
-        print_formula(root->data.op.right, precision);
+    init_walk(&w);
+    enter_node(&w, root);
 
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator != root->data.op.
-            operator)
-            printf(")");
-        break;
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
+        root = step->node;
 
-    case NUMBER:
-        printf("%.*Lf", precision, root->data.value);
-        break;
+        if (HAS_PARTS(root)) {
+            child = formula_part(root, step->state++, text);
+            fputs(text, f);
 
-    case VARIABLE:
-        printf("%c", root->data.name);
-        break;
+            if (child != NULL)
+                enter_node(&w, child);
+            else
+                w.count--;
 
-    default:
-        fprintf(stderr, "ERROR\n");
-        break;
+            continue;
+        }
+
+        switch (root->type) {
+        case NUMBER:
+            print_number(f, precision, root->data.value);
+            break;
+
+        case VARIABLE:
+            fprintf(f, "%c", root->data.name);
+            break;
+
+        default:
+            fprintf(stderr, "ERROR\n");
+            break;
+        }
+
+        w.count--;
     }
 
-    f--;
+    free_walk(&w);
+}
 
-    if (f == 0)
-        printf("\n");
+void print_formula(struct Node *root, int precision)
+{
+    if (root == NULL)
+        return;
+
+    write_formula(stdout, root, precision);
+    printf("\n");
 }
 
 static void add_subtrees(struct Node *root, struct List *l, int operator)
 {
-    if (root == NULL)
+    struct Walk w;
+    struct Step *step;
+    struct Node **place;
+
+    if (root == NULL || !IN_CHAIN(root, operator))
         return;
 
-    if (root->type == OPERATOR && root->data.op.operator == operator) {
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator == operator
-            && root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator == operator) {
-            add_subtrees(root->data.op.left, l, operator);
-            add_subtrees(root->data.op.right, l, operator);
-            return;
-        }
+    init_walk(&w);
+    enter_node(&w, root);
 
-        if (root->data.op.right->type == OPERATOR
-            && root->data.op.right->data.op.operator == operator) {
-            add_subtrees(root->data.op.right, l, operator);
-            add_node(l, root->data.op.left);
-            return;
-        }
+    while (w.count > 0) {
+        step = TOP_STEP(&w);
 
-        if (root->data.op.left->type == OPERATOR
-            && root->data.op.left->data.op.operator == operator) {
-            add_subtrees(root->data.op.left, l, operator);
-            add_node(l, root->data.op.right);
-            return;
+        if (step->state == 2) {
+            w.count--;
+            continue;
         }
 
-        add_node(l, root->data.op.left);
-        add_node(l, root->data.op.right);
+        place = chain_place(step->node, operator, step->state++);
+
+        if (IN_CHAIN(*place, operator))
+            enter_node(&w, *place);
+        else
+            add_node(l, *place);
     }
+
+    free_walk(&w);
 }
 
-struct List *get_operands(struct Node *root, int operator)
+/* collects the operands of a chain of one operator like "a+b+c"
+ * 1. argument: pointer of the chain
+ * 2. argument: the operator
+ * 3. argument: list that receives the operands
+ * return value: number of operands */
+unsigned int get_operands(struct Node *root, int operator, struct List *l)
 {
-    struct List *l;
-
-    l = new_list();
-
+    l->count = 0;
     add_subtrees(root, l, operator);
 
-    if (l->count == 0) {
-        free(l);
-        return (NULL);
-    }
-
-    return (l);
+    return (l->count);
 }
@@ -21,6 +21,11 @@
 #ifndef FP_NODE_H
 #define FP_NODE_H
 
+#include <stdio.h>
+#include <stdint.h>
+
+#include "number.h"
+
 /* node types */
 #define OPERATOR     0
 #define NUMBER       1
@@ -38,6 +43,25 @@
 /* Error */
 #define ERROR 10
 
+/* number of variables (a-z) */
+#define VARIABLES 26
+
+/* index of a variable in an array of values */
+#define VARIABLE_SLOT(node) ((node)->data.name - 'a')
+
+/* bit of a variable in the variables of a node */
+#define VARIABLE_BIT(name) (1UL << ((name) - 'a'))
+
+/* a node of a chain of one operator like "a+b+c" */
+#define IN_CHAIN(node, o) \
+    ((node)->type == OPERATOR && (node)->data.op.operator == (o))
+
+/* number of steps a walk keeps without allocating memory */
+#define WALK_INLINE 64
+
+struct Arena;
+struct List;
+
 struct Operator {
     int operator;
     struct Node *left;
@@ -51,7 +75,7 @@ struct Conditional {
 };
 
 union Data {
-    long double value;
+    number value;
 
     char name;
 
@@ -61,32 +85,73 @@ union Data {
 
 struct Node {
     int type;
+    char in_arena;
+    char shared;                /* used more than once (see share_tree) */
     char *formula;
+    uint64_t hash;              /* equal trees have equal hashes */
+    struct Node *parent;        /* NULL for the root of a tree */
+
+    /* summary of the subtree, kept with the hash (see hash_node) */
+    uint32_t variables;         /* bit v is set if variable v is used */
+    uint32_t size;              /* number of nodes */
+    uint32_t depth;             /* 1 for a leaf */
 
     union Data data;
 };
 
+/* a node on the way through a tree and the index of the child that
+ * is visited next (see child_node) */
+struct Step {
+    struct Node *node;
+    int state;
+};
+
+/* the way from the root of a tree to the current node, trees are walked
+ * with this stack instead of recursion because their depth is only
+ * limited by the length of the formula
+ * (a walk must not be copied, step may point into it)
+ * the steps are step[0] ... step[count - 1] */
+struct Walk {
+    struct Step *step;
+    size_t count;
+    size_t size;
+    struct Step small[WALK_INLINE];
+};
+
+/* the current step of a walk, it moves when a node is entered */
+#define TOP_STEP(w) (&(w)->step[(w)->count - 1])
+
 extern struct Node *new_operator_node(char);
 extern struct Node *new_variable_node(char);
-extern struct Node *new_number_node(double);
+extern struct Node *new_number_node(number);
 extern struct Node *new_conditional_node(struct Node *, struct Node *,
                                          struct Node *);
+extern struct Arena *set_arena(struct Arena *);
 extern struct Node *new_node(void);
 extern void delete_node(struct Node *);
 extern void delete_tree(struct Node *);
 extern struct Node *set_childs(struct Node *, struct Node *,
                                struct Node *);
+extern void move_node(struct Node *, struct Node *);
 extern char otoa(int);
 extern int atoo(char);
 extern int cmp_nodes(struct Node *, struct Node *);
 extern void print_node(struct Node *);
 extern char *get_formula(struct Node *);
 extern int cmp_trees(struct Node *, struct Node *);
+extern void hash_node(struct Node *);
+extern void hash_chain(struct Node *, int);
 extern struct Node *get_parent(struct Node *, struct Node *);
+extern void write_formula(FILE *, struct Node *, int);
 extern void print_formula(struct Node *, int);
 extern void sort_tree(struct Node *);
-extern struct List *get_operands(struct Node *, int);
+extern void share_tree(struct Node *);
+extern unsigned int get_operands(struct Node *, int, struct List *);
 extern void update(struct Node *);
 extern void print_tree(struct Node *root);
+extern struct Node *child_node(struct Node *, int);
+extern void init_walk(struct Walk *);
+extern void enter_node(struct Walk *, struct Node *);
+extern void free_walk(struct Walk *);
 
 #endif
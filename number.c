@@ -0,0 +1,190 @@
+/*
+    fp - number.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "number.h"
+
+static const char *names[] = { "float", "double", "ldouble", "float128" };
+
+/* most significant digits of a decimal that fit the fast path */
+#define FAST_DIGITS 19
+
+/* powers of ten that are exact in the type of the tree */
+static const long double powers[] = {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L,
+    1e10L, 1e11L, 1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L,
+    1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+
+/* 10^e is exact as long as 5^e fits the mantissa */
+#if NUMBER_MANT_DIG >= 64 && LDBL_MANT_DIG >= 64
+#define EXACT_POWER 27
+#elif NUMBER_MANT_DIG >= 53
+#define EXACT_POWER 22
+#else
+#define EXACT_POWER 10
+#endif
+
+/* converts the name of a numeric type
+ * 1. argument: name (float, double, ldouble or float128)
+ * return value: TYPE_* or -1 if the type is unknown or not available */
+int number_type(const char *name)
+{
+    int i;
+
+    if (strcmp(name, "long double") == 0)
+        return (TYPE_LDOUBLE);
+
+    for (i = TYPE_FLOAT; i <= TYPE_FLOAT128; i++) {
+        if (strcmp(name, names[i]) == 0) {
+#ifndef FP_QUADMATH
+            if (i == TYPE_FLOAT128)
+                return (-1);
+#endif
+            return (i);
+        }
+    }
+
+    return (-1);
+}
+
+/* converts a decimal like "12.345E-7" to the type of the tree, correctly
+ * rounded: if the significant digits and the power of ten are both exact
+ * one multiplication or division rounds the result (Clinger's fast path),
+ * all other decimals are converted by the C library
+ * 1. argument: digits, an optional '.' with digits and an optional
+ *              'E' with an optional '-' and digits
+ * return value: the number */
+number decimal_to_number(const char *s)
+{
+    const char *p;
+    uint64_t m;
+    long e, exponent;
+    int digits, negative;
+    number r;
+
+    m = 0;
+    e = exponent = 0;
+    digits = negative = 0;
+
+    for (p = s; *p >= '0' && *p <= '9'; p++) {
+        m = m * 10 + (*p - '0');
+
+        if (m != 0)
+            digits++;
+    }
+
+    if (*p == '.')
+        for (p++; *p >= '0' && *p <= '9'; p++, e--) {
+            m = m * 10 + (*p - '0');
+
+            if (m != 0)
+                digits++;
+        }
+
+    if (*p == 'E') {
+        if (*++p == '-') {
+            negative = 1;
+            p++;
+        }
+
+        /* larger exponents are out of range anyway */
+        for (; *p >= '0' && *p <= '9'; p++)
+            if (exponent < 100000)
+                exponent = exponent * 10 + (*p - '0');
+    }
+
+    e += negative ? -exponent : exponent;
+
+    if (digits == 0)
+        return (0);
+
+    if (digits <= FAST_DIGITS
+        && (NUMBER_MANT_DIG >= 64 || m >> NUMBER_MANT_DIG == 0)
+        && e >= -EXACT_POWER && e <= EXACT_POWER) {
+        r = m;
+
+        return (e < 0 ? r / (number) powers[-e] : r * (number) powers[e]);
+    }
+
+    return (string_to_number(s));
+}
+
+const char *number_type_name(int type)
+{
+    if (type < TYPE_FLOAT || type > TYPE_FLOAT128)
+        return ("unknown");
+
+    return (names[type]);
+}
+
+/* writes a number into a string, like snprintf() nothing is written
+ * when the size is 0
+ * 1. argument: the string
+ * 2. argument: size of the string
+ * 3. argument: number of decimals
+ * 4. argument: the number
+ * return value: length of the number */
+int format_number(char *s, size_t size, int precision, wide_number n)
+{
+#ifdef FP_QUADMATH
+    return (quadmath_snprintf(s, size, "%.*Qf", precision, n));
+#else
+    return (snprintf(s, size, "%.*Lf", precision, n));
+#endif
+}
+
+/* formats a number with a fixed number of decimals
+ * 1. argument: the number
+ * 2. argument: number of decimals
+ * return value: allocated string */
+char *number_to_string(wide_number n, int precision)
+{
+    char *s;
+    int length;
+
+    length = format_number(NULL, 0, precision, n);
+
+    if ((s = malloc(length + 1)) == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    format_number(s, length + 1, precision, n);
+
+    return (s);
+}
+
+void print_number(FILE *f, int precision, wide_number n)
+{
+#ifdef FP_QUADMATH
+    char *s;
+
+    s = number_to_string(n, precision);
+    fputs(s, f);
+    free(s);
+#else
+    fprintf(f, "%.*Lf", precision, n);
+#endif
+}
@@ -0,0 +1,81 @@
+/*
+    fp - number.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_NUMBER_H
+#define FP_NUMBER_H
+
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+
+#ifdef FP_QUADMATH
+#include <quadmath.h>
+__extension__ typedef __float128 float128;
+#endif
+
+/* numeric types of the evaluators (-t) */
+#define TYPE_FLOAT    0
+#define TYPE_DOUBLE   1
+#define TYPE_LDOUBLE  2
+#define TYPE_FLOAT128 3
+
+/* type of the numbers in the parse tree, chosen at build time:
+ * make NUMBER=float|double|ldouble|float128 */
+#if defined(FP_NUMBER_FLOAT)
+typedef float number;
+#define NUMBER_TYPE TYPE_FLOAT
+#define NUMBER_MANT_DIG FLT_MANT_DIG
+#define number_pow powf
+#define string_to_number(s) strtof((s), NULL)
+#elif defined(FP_NUMBER_DOUBLE)
+typedef double number;
+#define NUMBER_TYPE TYPE_DOUBLE
+#define NUMBER_MANT_DIG DBL_MANT_DIG
+#define number_pow pow
+#define string_to_number(s) strtod((s), NULL)
+#elif defined(FP_NUMBER_FLOAT128) && defined(FP_QUADMATH)
+typedef float128 number;
+#define NUMBER_TYPE TYPE_FLOAT128
+#define NUMBER_MANT_DIG FLT128_MANT_DIG
+#define number_pow powq
+#define string_to_number(s) strtoflt128((s), NULL)
+#else
+typedef long double number;
+#define NUMBER_TYPE TYPE_LDOUBLE
+#define NUMBER_MANT_DIG LDBL_MANT_DIG
+#define number_pow powl
+#define string_to_number(s) strtold((s), NULL)
+#endif
+
+/* type that holds the results of all evaluators */
+#ifdef FP_QUADMATH
+typedef float128 wide_number;
+#else
+typedef long double wide_number;
+#endif
+
+extern int number_type(const char *);
+extern const char *number_type_name(int);
+extern void print_number(FILE *, int, wide_number);
+extern int format_number(char *, size_t, int, wide_number);
+extern char *number_to_string(wide_number, int);
+extern number decimal_to_number(const char *);
+
+#endif
@@ -0,0 +1,468 @@
+/*
+    fp - parallel.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "node.h"
+#include "parallel.h"
+
+/* no chunk left to take */
+#define NO_CHUNK ((size_t) -1)
+
+/* no task left to take */
+#define NO_TASK ((size_t) -1)
+
+/* lines of the file that are calculated by one worker at once,
+ * the output is kept until all chunks before are written */
+struct Chunk {
+    const char *line[CHUNK_LINES];
+    size_t length[CHUNK_LINES];
+    size_t lines;
+    char *text;                 /* copies of the lines of a pipe */
+    size_t size;
+    char *output;
+    size_t output_length;
+    char *errors;
+    size_t errors_length;
+    int done;
+};
+
+struct Pool;
+
+/* a thread with the chunks next..end-1 of the current batch,
+ * it takes them from the front and other workers steal from the back */
+struct Worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+    struct Pool *pool;
+};
+
+struct Pool {
+    struct Chunk *chunk;
+    size_t chunks;
+    struct Worker *worker;
+    int workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work;        /* a new batch was read */
+    pthread_cond_t done;        /* a chunk was calculated */
+    unsigned long batch;
+    int finished;
+    line_function function;
+    void *data;
+};
+
+/* tasks that are taken by the threads in the order of their indices */
+struct Tasks {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t count;
+    task_function function;
+    void *data;
+};
+
+/* set on the workers of process_lines(), they do their tasks alone
+ * because the other workers keep the processors busy */
+static __thread int line_worker = 0;
+
+/* number of threads that calculate one large formula */
+static int threads_per_formula = 1;
+
+static void check(int error, const char *function)
+{
+    if (error != 0) {
+        errno = error;
+        perror(function);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* reads the next lines of a file into a chunk, lines of a mapped file
+ * are used in place, lines of a pipe are copied because the buffer of
+ * the input is reused
+ * 1. argument: pointer of the chunk
+ * 2. argument: the input
+ * return value: number of lines read */
+static size_t read_chunk(struct Chunk *c, struct Input *in)
+{
+    const char *line;
+    size_t length, used, i;
+
+    used = 0;
+
+    for (c->lines = 0; c->lines < CHUNK_LINES
+         && next_line(in, &line, &length); c->lines++) {
+        c->line[c->lines] = line;
+        c->length[c->lines] = length;
+
+        if (in->mapped)
+            continue;
+
+        if (used + length > c->size) {
+            c->size = 2 * c->size + length;
+
+            if ((c->text = realloc(c->text, c->size)) == NULL) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        memcpy(c->text + used, line, length);
+        used += length;
+    }
+
+    /* the copies are placed after the text stopped moving */
+    if (!in->mapped)
+        for (i = 0, used = 0; i < c->lines; used += c->length[i++])
+            c->line[i] = c->text + used;
+
+    return (c->lines);
+}
+
+/* takes a chunk of the own worker or steals one of another worker
+ * 1. argument: pointer of the worker
+ * return value: index of the chunk or NO_CHUNK */
+static size_t take_chunk(struct Worker *w)
+{
+    struct Pool *pool;
+    struct Worker *victim;
+    size_t c;
+    int i;
+
+    pool = w->pool;
+    c = NO_CHUNK;
+
+    check(pthread_mutex_lock(&w->lock), "pthread_mutex_lock");
+
+    if (w->next < w->end)
+        c = w->next++;
+
+    check(pthread_mutex_unlock(&w->lock), "pthread_mutex_unlock");
+
+    for (i = 1; c == NO_CHUNK && i < pool->workers; i++) {
+        victim = &pool->worker[(w - pool->worker + i) % pool->workers];
+
+        check(pthread_mutex_lock(&victim->lock), "pthread_mutex_lock");
+
+        if (victim->next < victim->end)
+            c = --victim->end;
+
+        check(pthread_mutex_unlock(&victim->lock), "pthread_mutex_unlock");
+    }
+
+    return (c);
+}
+
+/* calculates all lines of a chunk
+ * 1. argument: the pool
+ * 2. argument: pointer of the chunk
+ * 3. argument: arena of the worker
+ * return value: none */
+static void run_chunk(struct Pool *pool, struct Chunk *c, struct Arena *a)
+{
+    FILE *output, *errors;
+    size_t i;
+
+    if ((output = open_memstream(&c->output, &c->output_length)) == NULL
+        || (errors = open_memstream(&c->errors, &c->errors_length))
+        == NULL) {
+        perror("open_memstream");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < c->lines; i++) {
+        /* empty string */
+        if (c->length[i] == 0)
+            continue;
+
+        reset_arena(a);
+        pool->function(c->line[i], c->length[i], output, errors,
+                       pool->data);
+    }
+
+    fclose(output);
+    fclose(errors);
+
+    check(pthread_mutex_lock(&pool->lock), "pthread_mutex_lock");
+    c->done = 1;
+    check(pthread_cond_broadcast(&pool->done), "pthread_cond_broadcast");
+    check(pthread_mutex_unlock(&pool->lock), "pthread_mutex_unlock");
+}
+
+static void *work(void *data)
+{
+    struct Worker *w;
+    struct Pool *pool;
+    struct Arena *a;
+    unsigned long seen;
+    size_t c;
+
+    w = data;
+    pool = w->pool;
+    seen = 0;
+
+    line_worker = 1;
+
+    /* all nodes of one formula are freed at once */
+    a = new_arena();
+    set_arena(a);
+
+    for (;;) {
+        check(pthread_mutex_lock(&pool->lock), "pthread_mutex_lock");
+
+        while (pool->batch == seen && !pool->finished)
+            check(pthread_cond_wait(&pool->work, &pool->lock),
+                  "pthread_cond_wait");
+
+        if (pool->batch == seen) {
+            check(pthread_mutex_unlock(&pool->lock),
+                  "pthread_mutex_unlock");
+            break;
+        }
+
+        seen = pool->batch;
+        check(pthread_mutex_unlock(&pool->lock), "pthread_mutex_unlock");
+
+        while ((c = take_chunk(w)) != NO_CHUNK)
+            run_chunk(pool, &pool->chunk[c], a);
+    }
+
+    set_arena(NULL);
+    delete_arena(a);
+
+    return (NULL);
+}
+
+/* calls a function for every line of a file on several threads,
+ * the output of the lines is written in the order of the file
+ * 1. argument: the input
+ * 2. argument: number of threads
+ * 3. argument: function called for every line that is not empty
+ * 4. argument: data passed to the function
+ * return value: none */
+void process_lines(struct Input *in, int threads, line_function function,
+                   void *data)
+{
+    struct Pool pool;
+    struct Chunk *c;
+    size_t count, k;
+    int i;
+
+    if (threads < 1)
+        threads = 1;
+
+    if (threads > MAX_WORKERS)
+        threads = MAX_WORKERS;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.workers = threads;
+    pool.chunks = (size_t) threads * CHUNKS_PER_WORKER;
+    pool.function = function;
+    pool.data = data;
+
+    if ((pool.chunk = calloc(pool.chunks, sizeof(struct Chunk))) == NULL
+        || (pool.worker = calloc(threads, sizeof(struct Worker))) == NULL) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    check(pthread_mutex_init(&pool.lock, NULL), "pthread_mutex_init");
+    check(pthread_cond_init(&pool.work, NULL), "pthread_cond_init");
+    check(pthread_cond_init(&pool.done, NULL), "pthread_cond_init");
+
+    for (i = 0; i < threads; i++) {
+        pool.worker[i].pool = &pool;
+        check(pthread_mutex_init(&pool.worker[i].lock, NULL),
+              "pthread_mutex_init");
+    }
+
+    for (i = 0; i < threads; i++)
+        check(pthread_create(&pool.worker[i].thread, NULL, work,
+                             &pool.worker[i]), "pthread_create");
+
+    for (;;) {
+        /* read the next batch of chunks */
+        for (count = 0; count < pool.chunks; count++) {
+            c = &pool.chunk[count];
+            c->done = 0;
+
+            if (read_chunk(c, in) == 0)
+                break;
+
+            if (c->lines < CHUNK_LINES) {
+                count++;
+                break;
+            }
+        }
+
+        if (count == 0)
+            break;
+
+        /* every worker gets a part of the batch */
+        for (i = 0; i < threads; i++) {
+            check(pthread_mutex_lock(&pool.worker[i].lock),
+                  "pthread_mutex_lock");
+            pool.worker[i].next = count * i / threads;
+            pool.worker[i].end = count * (i + 1) / threads;
+            check(pthread_mutex_unlock(&pool.worker[i].lock),
+                  "pthread_mutex_unlock");
+        }
+
+        check(pthread_mutex_lock(&pool.lock), "pthread_mutex_lock");
+        pool.batch++;
+        check(pthread_cond_broadcast(&pool.work), "pthread_cond_broadcast");
+        check(pthread_mutex_unlock(&pool.lock), "pthread_mutex_unlock");
+
+        /* write the chunks in order as soon as they are calculated */
+        for (k = 0; k < count; k++) {
+            c = &pool.chunk[k];
+
+            check(pthread_mutex_lock(&pool.lock), "pthread_mutex_lock");
+
+            while (!c->done)
+                check(pthread_cond_wait(&pool.done, &pool.lock),
+                      "pthread_cond_wait");
+
+            check(pthread_mutex_unlock(&pool.lock), "pthread_mutex_unlock");
+
+            fwrite(c->output, 1, c->output_length, stdout);
+
+            if (c->errors_length > 0) {
+                fflush(stdout);
+                fwrite(c->errors, 1, c->errors_length, stderr);
+            }
+
+            free(c->output);
+            free(c->errors);
+        }
+
+        if (count < pool.chunks || pool.chunk[count - 1].lines < CHUNK_LINES)
+            break;
+    }
+
+    check(pthread_mutex_lock(&pool.lock), "pthread_mutex_lock");
+    pool.finished = 1;
+    check(pthread_cond_broadcast(&pool.work), "pthread_cond_broadcast");
+    check(pthread_mutex_unlock(&pool.lock), "pthread_mutex_unlock");
+
+    /* the locks are destroyed when no worker can steal anymore */
+    for (i = 0; i < threads; i++)
+        check(pthread_join(pool.worker[i].thread, NULL), "pthread_join");
+
+    for (i = 0; i < threads; i++)
+        pthread_mutex_destroy(&pool.worker[i].lock);
+
+    for (k = 0; k < pool.chunks; k++)
+        free(pool.chunk[k].text);
+
+    pthread_cond_destroy(&pool.done);
+    pthread_cond_destroy(&pool.work);
+    pthread_mutex_destroy(&pool.lock);
+    free(pool.chunk);
+    free(pool.worker);
+}
+
+static void *run_tasks(void *data)
+{
+    struct Tasks *t;
+    size_t i;
+
+    t = data;
+
+    for (;;) {
+        check(pthread_mutex_lock(&t->lock), "pthread_mutex_lock");
+        i = (t->next < t->count) ? t->next++ : NO_TASK;
+        check(pthread_mutex_unlock(&t->lock), "pthread_mutex_unlock");
+
+        if (i == NO_TASK)
+            break;
+
+        t->function(i, t->data);
+    }
+
+    return (NULL);
+}
+
+/* calls a function for the tasks 0 ... count - 1 on several threads and
+ * returns when all of them are done, the calling thread is one of the
+ * threads (the others have no arena), a worker of process_lines() uses
+ * no more threads
+ * 1. argument: number of tasks
+ * 2. argument: number of threads
+ * 3. argument: function called for every task
+ * 4. argument: data passed to the function
+ * return value: none */
+void process_tasks(size_t count, int threads, task_function function,
+                   void *data)
+{
+    pthread_t thread[MAX_WORKERS];
+    struct Tasks t;
+    int i;
+
+    if (threads > MAX_WORKERS)
+        threads = MAX_WORKERS;
+
+    if (line_worker)
+        threads = 1;
+
+    if ((size_t) threads > count)
+        threads = (int) count;
+
+    t.next = 0;
+    t.count = count;
+    t.function = function;
+    t.data = data;
+
+    check(pthread_mutex_init(&t.lock, NULL), "pthread_mutex_init");
+
+    for (i = 1; i < threads; i++)
+        check(pthread_create(&thread[i], NULL, run_tasks, &t),
+              "pthread_create");
+
+    run_tasks(&t);
+
+    for (i = 1; i < threads; i++)
+        check(pthread_join(thread[i], NULL), "pthread_join");
+
+    pthread_mutex_destroy(&t.lock);
+}
+
+/* sets the number of threads that calculate one large formula
+ * 1. argument: number of threads
+ * return value: none */
+void set_task_threads(int threads)
+{
+    threads_per_formula = (threads < 1) ? 1 : threads;
+}
+
+/* returns the number of threads that calculate one large formula,
+ * a worker of process_lines() calculates its formulas alone
+ * 1. argument: none
+ * return value: number of threads */
+int task_threads(void)
+{
+    return (line_worker ? 1 : threads_per_formula);
+}
@@ -0,0 +1,59 @@
+/*
+    fp - parallel.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_PARALLEL_H
+#define FP_PARALLEL_H
+
+#include <stdio.h>
+
+#include "input.h"
+
+/* number of lines a worker takes at once */
+#define CHUNK_LINES 256
+
+/* number of chunks per worker that are read before they are calculated */
+#define CHUNKS_PER_WORKER 8
+
+/* maximal number of workers */
+#define MAX_WORKERS 256
+
+/* trees and programs with fewer nodes are calculated on one thread */
+#define PARALLEL_NODES (1 << 16)
+
+/* subtrees with fewer nodes are not worth a thread */
+#define PART_NODES (1 << 10)
+
+/* number of parts a tree is split into per thread, so that threads
+ * which are done early take the parts of the others */
+#define PARTS_PER_THREAD 4
+
+/* called by a worker for every line that is not empty (with its length),
+ * output goes to the 3rd and error messages to the 4th argument */
+typedef void (*line_function)(const char *, size_t, FILE *, FILE *, void *);
+
+/* called by a thread for every task (with its index) */
+typedef void (*task_function)(size_t, void *);
+
+extern void process_lines(struct Input *, int, line_function, void *);
+extern void process_tasks(size_t, int, task_function, void *);
+extern void set_task_threads(int);
+extern int task_threads(void);
+
+#endif
@@ -0,0 +1,551 @@
+/*
+    fp - program.c
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "node.h"
+#include "flat.h"
+#include "parallel.h"
+#include "program.h"
+
+static void *xcalloc(size_t n, size_t size)
+{
+    void *p;
+
+    if ((p = calloc(n ? n : 1, size)) == NULL) {
+        perror("calloc(program)");
+        exit(EXIT_FAILURE);
+    }
+
+    return (p);
+}
+
+static uint32_t emit(struct Program *p, uint32_t opcode, uint32_t arg)
+{
+    p->code[p->length].opcode = opcode;
+    p->code[p->length].arg = arg;
+
+    return (p->length++);
+}
+
+/* finds the parts of a large program, the largest subtrees with at
+ * most the given number of nodes that can be calculated on their own:
+ * no reference crosses their border and they are not inside a branch
+ * of a conditional, which is only calculated sometimes
+ * 1. argument: pointer of the flat tree
+ * 2. argument: maximal number of nodes of a part
+ * 3. argument: position of the code of every node
+ * 4. argument: position after the code of every node
+ * 5. argument: array that receives the parts in the order of the code
+ * return value: number of parts */
+static uint32_t find_parts(struct FlatTree *t, uint32_t nodes,
+                           const uint32_t *begin, const uint32_t *end,
+                           struct ProgramPart *part)
+{
+    uint32_t *first, *low, *high, *stack;
+    uint32_t i, c, n, parts;
+
+    first = xcalloc(t->count, sizeof(uint32_t));
+    low = xcalloc(t->count, sizeof(uint32_t));
+    high = xcalloc(t->count, sizeof(uint32_t));
+    stack = xcalloc(t->count, sizeof(uint32_t));
+
+    /* the last reference to a node */
+    for (i = 0; i < t->count; i++)
+        if (t->kind[i] == REFERENCE)
+            high[t->left[i]] = i;
+
+    /* the subtree of node i are the nodes first[i] ... i, the subtrees
+     * of its children follow each other up to node i - 1, low is the
+     * lowest node and high the last node that the subtree refers to
+     * or that refers to it */
+    for (i = 0; i < t->count; i++) {
+        switch (t->kind[i]) {
+        case NUMBER:
+        case VARIABLE:
+        case REFERENCE:
+            first[i] = i;
+            break;
+
+        case SUM:
+        case PRODUCT:
+            first[i] = first[t->operand[t->left[i] + 1]];
+            break;
+
+        case CONDITIONAL:
+            first[i] = first[t->con[t->left[i]].condition];
+            break;
+
+        default:
+            first[i] = first[t->left[i]];
+            break;
+        }
+
+        low[i] = (t->kind[i] == REFERENCE) ? t->left[i] : i;
+
+        if (high[i] < i)
+            high[i] = i;
+
+        for (c = i; c > first[i]; c = first[c - 1]) {
+            if (low[c - 1] < low[i])
+                low[i] = low[c - 1];
+
+            if (high[c - 1] > high[i])
+                high[i] = high[c - 1];
+        }
+    }
+
+    /* the first child is taken first to keep the order of the code */
+    parts = n = 0;
+    stack[n++] = t->count - 1;
+
+    while (n > 0) {
+        i = stack[--n];
+
+        if (i - first[i] + 1 < PART_NODES)
+            continue;
+
+        if (i - first[i] + 1 <= nodes && low[i] >= first[i]
+            && high[i] == i) {
+            part[parts].begin = begin[first[i]];
+            part[parts].end = end[i];
+            parts++;
+            continue;
+        }
+
+        switch (t->kind[i]) {
+        case NUMBER:
+        case VARIABLE:
+        case REFERENCE:
+            break;
+
+        case CONDITIONAL:
+            stack[n++] = t->con[t->left[i]].condition;
+            break;
+
+        default:
+            for (c = i; c > first[i]; c = first[c - 1])
+                stack[n++] = c - 1;
+            break;
+        }
+    }
+
+    free(stack);
+    free(high);
+    free(low);
+    free(first);
+
+    return (parts);
+}
+
+/* splits a large program into parts that run on several threads and
+ * the outer code, which has an OP_FETCH in the place of every part
+ * 1. argument: pointer of the program
+ * 2. argument: pointer of the flat tree
+ * 3. argument: position of the code of every node
+ * 4. argument: position after the code of every node
+ * 5. argument: number of threads
+ * return value: none */
+static void split_program(struct Program *p, struct FlatTree *t,
+                          const uint32_t *begin, const uint32_t *end,
+                          int threads)
+{
+    uint32_t *position, nodes, i, k, n;
+
+    nodes = t->count / (PARTS_PER_THREAD * threads);
+
+    if (nodes < PART_NODES)
+        nodes = PART_NODES;
+
+    p->part = xcalloc(t->count / PART_NODES + 1, sizeof(struct ProgramPart));
+    p->parts = find_parts(t, nodes, begin, end, p->part);
+
+    /* one part is the whole program */
+    if (p->parts < 2) {
+        free(p->part);
+        p->part = NULL;
+        p->parts = 0;
+        return;
+    }
+
+    p->outer = xcalloc(p->length, sizeof(struct Instruction));
+
+    /* position of every instruction in the outer code */
+    position = xcalloc(p->length + 1, sizeof(uint32_t));
+
+    for (i = k = n = 0; i < p->length; n++) {
+        position[i] = n;
+
+        if (k < p->parts && i == p->part[k].begin) {
+            p->outer[n].opcode = OP_FETCH;
+            p->outer[n].arg = p->temporaries + k;
+
+            for (i++; i < p->part[k].end; i++)
+                position[i] = n;
+
+            k++;
+            continue;
+        }
+
+        p->outer[n] = p->code[i++];
+    }
+
+    position[p->length] = n;
+    p->outer_length = n;
+
+    /* the jumps of the outer code never go into a part */
+    for (i = 0; i < n; i++)
+        if (p->outer[i].opcode == OP_JZ || p->outer[i].opcode == OP_JMP)
+            p->outer[i].arg = position[p->outer[i].arg];
+
+    free(position);
+}
+
+/* compiles a flat tree into a stack program
+ * the flat tree is already in post-order, so every node becomes one
+ * instruction; a conditional additionally gets a OP_JZ behind its
+ * condition and a OP_JMP behind its true branch, a node with references
+ * gets a OP_STORE and a reference becomes a OP_FETCH, the operands of a
+ * SUM or PRODUCT are on the stack together when it is calculated,
+ * a large program is split into parts for several threads
+ * 1. argument: pointer of the flat tree
+ * return value: pointer of the program */
+struct Program *compile_flat_tree(struct FlatTree *t)
+{
+    struct Program *p;
+    uint32_t *jz_after, *jmp_after, *jz, *jmp, *temporary, *begin, *end;
+    uint32_t i, k, depth;
+    int threads;
+
+    if (t == NULL || t->count == 0)
+        return (NULL);
+
+    p = xcalloc(1, sizeof(struct Program));
+
+    /* the code of every node is needed to split the program */
+    threads = task_threads();
+    begin = end = NULL;
+
+    if (threads > 1 && t->count >= PARALLEL_NODES) {
+        begin = xcalloc(t->count, sizeof(uint32_t));
+        end = xcalloc(t->count, sizeof(uint32_t));
+    }
+
+    /* temporary (+ 1) that keeps the value of node i */
+    temporary = xcalloc(t->count, sizeof(uint32_t));
+
+    for (i = 0; i < t->count; i++)
+        if (t->kind[i] == REFERENCE && temporary[t->left[i]] == 0)
+            temporary[t->left[i]] = ++p->temporaries;
+
+    /* each node, two jumps per conditional and the stores */
+    p->code = xcalloc(t->count + 2 * t->conditionals + p->temporaries,
+                      sizeof(struct Instruction));
+    p->constant_float = xcalloc(t->values, sizeof(float));
+    p->constant_double = xcalloc(t->values, sizeof(double));
+    p->constant_ldouble = xcalloc(t->values, sizeof(long double));
+#ifdef FP_QUADMATH
+    p->constant_float128 = xcalloc(t->values, sizeof(float128));
+#endif
+
+    /* conditional (+ 1) that waits for the end of node i */
+    jz_after = xcalloc(t->count, sizeof(uint32_t));
+    jmp_after = xcalloc(t->count, sizeof(uint32_t));
+
+    /* position of the jumps of a conditional */
+    jz = xcalloc(t->conditionals, sizeof(uint32_t));
+    jmp = xcalloc(t->conditionals, sizeof(uint32_t));
+
+    for (i = 0; i < t->count; i++) {
+        if (t->kind[i] == CONDITIONAL) {
+            k = t->left[i];
+            jz_after[t->con[k].condition] = k + 1;
+            jmp_after[t->con[k].true] = k + 1;
+        }
+    }
+
+    depth = 0;
+
+    for (i = 0; i < t->count; i++) {
+        if (begin != NULL)
+            begin[i] = p->length;
+
+        switch (t->kind[i]) {
+        case NUMBER:
+            k = p->constants++;
+            p->constant_float[k] = (float) t->value[t->left[i]];
+            p->constant_double[k] = (double) t->value[t->left[i]];
+            p->constant_ldouble[k] = (long double) t->value[t->left[i]];
+#ifdef FP_QUADMATH
+            p->constant_float128[k] = (float128) t->value[t->left[i]];
+#endif
+            emit(p, OP_PUSH, k);
+            depth++;
+            break;
+
+        case VARIABLE:
+            emit(p, OP_LOAD, t->left[i]);
+            depth++;
+            break;
+
+        case ADD:
+            emit(p, OP_ADD, 0);
+            depth--;
+            break;
+
+        case MINUS:
+            emit(p, OP_SUB, 0);
+            depth--;
+            break;
+
+        case MULTIPLY:
+            emit(p, OP_MUL, 0);
+            depth--;
+            break;
+
+        case DIVIDE:
+            emit(p, OP_DIV, 0);
+            depth--;
+            break;
+
+        case POWER:
+            emit(p, OP_POW, 0);
+            depth--;
+            break;
+
+        case E_SYMBOL:
+            emit(p, OP_EXP10, 0);
+            depth--;
+            break;
+
+        case REFERENCE:
+            emit(p, OP_FETCH, temporary[t->left[i]] - 1);
+            depth++;
+            break;
+
+        case SUM:
+        case PRODUCT:
+            k = t->operand[t->left[i]];
+            emit(p, t->kind[i] == SUM ? OP_SUM : OP_PRODUCT, k);
+            depth -= k - 1;
+            break;
+
+        case CONDITIONAL:
+            /* end of the false branch */
+            p->code[jmp[t->left[i]]].arg = p->length;
+            break;
+        }
+
+        if (end != NULL)
+            end[i] = p->length;
+
+        if (depth > p->depth)
+            p->depth = depth;
+
+        if (temporary[i])
+            emit(p, OP_STORE, temporary[i] - 1);
+
+        if (jz_after[i]) {
+            k = jz_after[i] - 1;
+            jz[k] = emit(p, OP_JZ, 0);
+            depth--;
+        }
+
+        if (jmp_after[i]) {
+            k = jmp_after[i] - 1;
+            jmp[k] = emit(p, OP_JMP, 0);
+
+            /* the false branch starts without the value of the true one */
+            p->code[jz[k]].arg = p->length;
+            depth--;
+        }
+    }
+
+    if (begin != NULL)
+        split_program(p, t, begin, end, threads);
+
+    free(temporary);
+    free(jz_after);
+    free(jmp_after);
+    free(jz);
+    free(jmp);
+    free(begin);
+    free(end);
+
+    return (p);
+}
+
+/* compiles a (reduced) parse tree into a stack program
+ * 1. argument: pointer of the tree
+ * return value: pointer of the program */
+struct Program *compile_tree(struct Node *root)
+{
+    struct FlatTree *t;
+    struct Program *p;
+
+    t = flatten(root);
+    p = compile_flat_tree(t);
+    delete_flat_tree(t);
+
+    return (p);
+}
+
+void delete_program(struct Program *p)
+{
+    if (p == NULL)
+        return;
+
+#ifdef FP_QUADMATH
+    free(p->constant_float128);
+#endif
+    free(p->outer);
+    free(p->part);
+    free(p->constant_ldouble);
+    free(p->constant_double);
+    free(p->constant_float);
+    free(p->code);
+    free(p);
+}
+
+/* the interpreter for every numeric type */
+
+#define RUN_NAME     run_program_float
+#define RUN_TYPE     float
+#define RUN_CONSTANT constant_float
+#define RUN_POW      powf
+#include "program_run.h"
+
+#define RUN_NAME     run_program_double
+#define RUN_TYPE     double
+#define RUN_CONSTANT constant_double
+#define RUN_POW      pow
+#include "program_run.h"
+
+#define RUN_NAME     run_program_ldouble
+#define RUN_TYPE     long double
+#define RUN_CONSTANT constant_ldouble
+#define RUN_POW      powl
+#include "program_run.h"
+
+#ifdef FP_QUADMATH
+#define RUN_NAME     run_program_float128
+#define RUN_TYPE     float128
+#define RUN_CONSTANT constant_float128
+#define RUN_POW      powq
+#include "program_run.h"
+#endif
+
+/* runs a program in the numeric type of the parse tree
+ * 1. argument: pointer of the program
+ * 2. argument: values of the variables a-z (NULL: all variables are 0)
+ * return value: the value of the formula */
+number run_program(struct Program *p, const number *vars)
+{
+    return (run_program_type(p, NUMBER_TYPE, vars));
+}
+
+/* runs a program in a numeric type chosen at run time
+ * 1. argument: pointer of the program
+ * 2. argument: TYPE_FLOAT, TYPE_DOUBLE, TYPE_LDOUBLE or TYPE_FLOAT128
+ * 3. argument: values of the variables a-z (NULL: all variables are 0)
+ * return value: the value of the formula */
+wide_number run_program_type(struct Program *p, int type,
+                             const number *vars)
+{
+    float f[VARIABLES];
+    double d[VARIABLES];
+    long double ld[VARIABLES];
+#ifdef FP_QUADMATH
+    float128 q[VARIABLES];
+#endif
+    int i;
+
+    switch (type) {
+    case TYPE_FLOAT:
+        for (i = 0; vars != NULL && i < VARIABLES; i++)
+            f[i] = (float) vars[i];
+
+        return (run_program_float(p, vars ? f : NULL));
+
+    case TYPE_DOUBLE:
+        for (i = 0; vars != NULL && i < VARIABLES; i++)
+            d[i] = (double) vars[i];
+
+        return (run_program_double(p, vars ? d : NULL));
+
+#ifdef FP_QUADMATH
+    case TYPE_FLOAT128:
+        for (i = 0; vars != NULL && i < VARIABLES; i++)
+            q[i] = (float128) vars[i];
+
+        return (run_program_float128(p, vars ? q : NULL));
+#endif
+
+    default:
+        for (i = 0; vars != NULL && i < VARIABLES; i++)
+            ld[i] = (long double) vars[i];
+
+        return (run_program_ldouble(p, vars ? ld : NULL));
+    }
+}
+
+void print_program(struct Program *p)
+{
+    static const char *names[] = {
+        "push", "load", "add", "sub", "mul", "div", "pow", "exp10",
+        "jz", "jmp", "store", "fetch", "sum", "prod"
+    };
+    uint32_t i;
+
+    if (p == NULL) {
+        printf("NULL\n");
+        return;
+    }
+
+    for (i = 0; i < p->length; i++) {
+        printf("%4u %-6s", i, names[p->code[i].opcode]);
+
+        switch (p->code[i].opcode) {
+        case OP_PUSH:
+            printf("%Lf", p->constant_ldouble[p->code[i].arg]);
+            break;
+
+        case OP_LOAD:
+            printf("%c", 'a' + p->code[i].arg);
+            break;
+
+        case OP_STORE:
+        case OP_FETCH:
+            printf("t%u", p->code[i].arg);
+            break;
+
+        case OP_JZ:
+        case OP_JMP:
+        case OP_SUM:
+        case OP_PRODUCT:
+            printf("%u", p->code[i].arg);
+            break;
+        }
+
+        printf("\n");
+    }
+}
@@ -0,0 +1,101 @@
+/*
+    fp - program.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FP_PROGRAM_H
+#define FP_PROGRAM_H
+
+#include <stdint.h>
+
+#include "number.h"
+#include "node.h"
+#include "flat.h"
+
+/* opcodes */
+#define OP_PUSH   0             /* push constant[arg] */
+#define OP_LOAD   1             /* push vars[arg] */
+#define OP_ADD    2
+#define OP_SUB    3
+#define OP_MUL    4
+#define OP_DIV    5
+#define OP_POW    6
+#define OP_EXP10  7             /* a * 10 ^ b */
+#define OP_JZ     8             /* pop, jump to arg if zero */
+#define OP_JMP    9             /* jump to arg */
+#define OP_STORE  10            /* copy the top to temporary[arg] */
+#define OP_FETCH  11            /* push temporary[arg] */
+#define OP_SUM    12            /* replace the top arg values by their sum */
+#define OP_PRODUCT 13           /* ... by their product */
+
+struct Instruction {
+    uint32_t opcode;
+    uint32_t arg;
+};
+
+/* code of a subtree that is calculated on its own, code[begin] ...
+ * code[end - 1] leave its value on an empty stack */
+struct ProgramPart {
+    uint32_t begin;
+    uint32_t end;
+};
+
+struct Program {
+    struct Instruction *code;
+    uint32_t length;
+
+    /* the constants converted to every numeric type */
+    uint32_t constants;
+    float *constant_float;
+    double *constant_double;
+    long double *constant_ldouble;
+#ifdef FP_QUADMATH
+    float128 *constant_float128;
+#endif
+
+    /* highest number of values on the stack */
+    uint32_t depth;
+
+    /* values of shared subtrees that are used again */
+    uint32_t temporaries;
+
+    /* the parts of a large program run on several threads first, the
+     * outer code fetches the value of part k from the temporary
+     * temporaries + k instead of calculating it (see split_program) */
+    struct ProgramPart *part;
+    uint32_t parts;
+    struct Instruction *outer;
+    uint32_t outer_length;
+};
+
+extern struct Program *compile_flat_tree(struct FlatTree *);
+extern struct Program *compile_tree(struct Node *);
+extern void delete_program(struct Program *);
+extern float run_program_float(struct Program *, const float *);
+extern double run_program_double(struct Program *, const double *);
+extern long double run_program_ldouble(struct Program *,
+                                       const long double *);
+#ifdef FP_QUADMATH
+extern float128 run_program_float128(struct Program *, const float128 *);
+#endif
+extern number run_program(struct Program *, const number *);
+extern wide_number run_program_type(struct Program *, int,
+                                    const number *);
+extern void print_program(struct Program *);
+
+#endif
@@ -0,0 +1,218 @@
+/*
+    fp - program_run.h
+
+    Copyright (C) 2011 Matthias Ruester <ruester@molgen.mpg.de>
+    Copyright (C) 2011 Max Planck Institut for Molecular Genetics
+
+    fp is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    fp is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Interpreter of a program for one numeric type.
+ * This file is included by program.c once per type with:
+ *   RUN_NAME      name of the function
+ *   RUN_TYPE      numeric type
+ *   RUN_CONSTANT  member of struct Program with the constants
+ *   RUN_POW       pow() for the type */
+
+#ifndef SMALL_STACK
+/* size of the stack that is kept on the C stack */
+#define SMALL_STACK 64
+
+/* names of the helpers of an interpreter, like run_program_float_code */
+#define RUN_JOIN(name, part) name##_##part
+#define RUN_HELPER(name, part) RUN_JOIN(name, part)
+#endif
+
+#define RUN_CODE  RUN_HELPER(RUN_NAME, code)
+#define RUN_PART  RUN_HELPER(RUN_NAME, part)
+#define RUN_TASKS RUN_HELPER(RUN_NAME, tasks)
+
+/* runs code[begin] ... code[end - 1], the jumps go to positions in code
+ * 1. argument: pointer of the program
+ * 2. argument: the code (p->code or p->outer)
+ * 3. argument: position of the first instruction
+ * 4. argument: position after the last instruction
+ * 5. argument: values of the variables a-z (NULL: all variables are 0)
+ * 6. argument: the stack (p->depth values)
+ * 7. argument: the temporaries
+ * return value: the value on the top of the stack */
+static RUN_TYPE RUN_CODE(struct Program *p, const struct Instruction *code,
+                         uint32_t begin, uint32_t end, const RUN_TYPE *vars,
+                         RUN_TYPE *stack, RUN_TYPE *temporary)
+{
+    const struct Instruction *pc, *last;
+    RUN_TYPE *sp;
+    uint32_t i, n, half;
+
+    /* sp points to the top of the stack */
+    sp = stack - 1;
+    pc = code + begin;
+    last = code + end;
+
+    while (pc < last) {
+        switch (pc->opcode) {
+        case OP_PUSH:
+            *++sp = p->RUN_CONSTANT[pc->arg];
+            break;
+
+        case OP_LOAD:
+            *++sp = (vars != NULL) ? vars[pc->arg] : 0;
+            break;
+
+        case OP_ADD:
+            sp--;
+            *sp += sp[1];
+            break;
+
+        case OP_SUB:
+            sp--;
+            *sp -= sp[1];
+            break;
+
+        case OP_MUL:
+            sp--;
+            *sp *= sp[1];
+            break;
+
+        case OP_DIV:
+            sp--;
+            *sp /= sp[1];
+            break;
+
+        case OP_POW:
+            sp--;
+            *sp = RUN_POW(*sp, sp[1]);
+            break;
+
+        case OP_EXP10:
+            sp--;
+            *sp *= RUN_POW(10, sp[1]);
+            break;
+
+        case OP_JZ:
+            if (!*sp--) {
+                pc = code + pc->arg;
+                continue;
+            }
+            break;
+
+        case OP_JMP:
+            pc = code + pc->arg;
+            continue;
+
+        case OP_STORE:
+            temporary[pc->arg] = *sp;
+            break;
+
+        case OP_FETCH:
+            *++sp = temporary[pc->arg];
+            break;
+
+        case OP_SUM:
+        case OP_PRODUCT:
+            /* the operands are combined pairwise in place, the upper
+             * half with the lower half until one value is left */
+            sp -= pc->arg - 1;
+
+            for (n = pc->arg; n > 1; n = half) {
+                half = (n + 1) / 2;
+
+                if (pc->opcode == OP_SUM)
+                    for (i = 0; i + half < n; i++)
+                        sp[i] += sp[i + half];
+                else
+                    for (i = 0; i + half < n; i++)
+                        sp[i] *= sp[i + half];
+            }
+            break;
+        }
+
+        pc++;
+    }
+
+    return (*sp);
+}
+
+/* what the threads need to calculate the parts of a program */
+struct RUN_TASKS {
+    struct Program *p;
+    const RUN_TYPE *vars;
+    RUN_TYPE *value;
+};
+
+static void RUN_PART(size_t k, void *data)
+{
+    struct RUN_TASKS *t;
+    RUN_TYPE *stack;
+
+    t = data;
+
+    /* the temporaries of a part are used only inside of it */
+    stack = xcalloc(t->p->depth + t->p->temporaries, sizeof(RUN_TYPE));
+    t->value[k] = RUN_CODE(t->p, t->p->code, t->p->part[k].begin,
+                           t->p->part[k].end, t->vars, stack,
+                           stack + t->p->depth);
+    free(stack);
+}
+
+RUN_TYPE RUN_NAME(struct Program *p, const RUN_TYPE *vars)
+{
+    RUN_TYPE small[SMALL_STACK], *stack, ret;
+    struct RUN_TASKS t;
+    int threads;
+
+    if (p == NULL || p->length == 0)
+        return (0);
+
+    threads = task_threads();
+
+    /* the parts are calculated on several threads first, their values
+     * are kept after the temporaries of the outer code */
+    if (p->parts > 0 && threads > 1) {
+        stack = xcalloc(p->depth + p->temporaries + p->parts,
+                        sizeof(RUN_TYPE));
+
+        t.p = p;
+        t.vars = vars;
+        t.value = stack + p->depth + p->temporaries;
+        process_tasks(p->parts, threads, RUN_PART, &t);
+
+        ret = RUN_CODE(p, p->outer, 0, p->outer_length, vars, stack,
+                       stack + p->depth);
+        free(stack);
+
+        return (ret);
+    }
+
+    /* the temporaries are kept above the stack */
+    if (p->depth + p->temporaries > SMALL_STACK)
+        stack = xcalloc(p->depth + p->temporaries, sizeof(RUN_TYPE));
+    else
+        stack = small;
+
+    ret = RUN_CODE(p, p->code, 0, p->length, vars, stack, stack + p->depth);
+
+    if (stack != small)
+        free(stack);
+
+    return (ret);
+}
+
+#undef RUN_CODE
+#undef RUN_PART
+#undef RUN_TASKS
+#undef RUN_NAME
+#undef RUN_TYPE
+#undef RUN_CONSTANT
+#undef RUN_POW
@@ -24,51 +24,121 @@
 
 #include "tokenizer.h"
 
-void next_token(struct Tokenizer *tokenizer)
-{
-    if (tokenizer->current_token == NULL)
-        return;
+/* SSE2 is part of every x86-64 cpu */
+#if defined(__SSE2__) && defined(__GNUC__)
+#define TOKENIZER_SSE2
+#include <emmintrin.h>
+#endif
 
-    tokenizer->current_token++;
+/* number of characters classified at once */
+#define BLOCK_SIZE 16
 
-    if (CURRENT_TOKEN == '\0')
-        return;
+static unsigned char classify(char c)
+{
+    if (c >= '0' && c <= '9')
+        return (TOKEN_DIGIT);
 
-    while (CURRENT_TOKEN == ' ')
-        tokenizer->current_token++;
+    if (c >= 'a' && c <= 'z')
+        return (TOKEN_LOWER);
 
-    tokenizer->position++;
+    return (TOKEN_SYMBOL);
 }
 
-struct Tokenizer *create_tokenizer(char *string)
+/* stores a token
+ * 1. argument: where the token is stored
+ * 2. argument: the character
+ * 3. argument: class of the character
+ * return value: where the next token is stored */
+static struct Token *add_token(struct Token *t, char c, unsigned char class)
 {
-    struct Tokenizer *tokenizer;
+    t->symbol = c;
+    t->class = class;
 
-    if (string == NULL)
-        return (NULL);
+    return (t + 1);
+}
 
-    tokenizer = malloc(sizeof(struct Tokenizer));
+#ifdef TOKENIZER_SSE2
 
-    if (!tokenizer) {
-        perror("malloc(tokenizer)");
-        exit(EXIT_FAILURE);
+/* adds the tokens of a block of characters, spaces are skipped
+ * 1. argument: where the tokens are stored
+ * 2. argument: string of the formula
+ * 3. argument: offset of the block in the string
+ * return value: where the next token is stored */
+static struct Token *add_block(struct Token *t, const char *string,
+                               size_t offset)
+{
+    __m128i v;
+    unsigned int space, digit, lower, k;
+
+    v = _mm_loadu_si128((const __m128i *) (string + offset));
+
+    space = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    digit = _mm_movemask_epi8(_mm_and_si128
+                              (_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+    lower = _mm_movemask_epi8(_mm_and_si128
+                              (_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                               _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1))));
+
+    /* every character that is not a space is a token,
+     * the class is 1 for digits and 2 for lower case letters */
+    for (space = ~space & 0xffff; space != 0; space &= space - 1) {
+        k = __builtin_ctz(space);
+
+        t = add_token(t, string[offset + k],
+                      ((digit >> k) & 1) | (((lower >> k) & 1) << 1));
     }
 
-    tokenizer->string = strdup(string);
+    return (t);
+}
 
-    if (!(tokenizer->string)) {
-        perror("strdup");
+#endif
+
+/* splits a formula into tokens, the string is not copied and must
+ * exist as long as the tokenizer
+ * (the first character is always a token, later spaces are skipped)
+ * 1. argument: pointer of the tokenizer
+ * 2. argument: string of the formula
+ * 3. argument: length of the string
+ * return value: none */
+void init_tokenizer(struct Tokenizer *tokenizer, const char *string,
+                    size_t length)
+{
+    struct Token *t;
+    size_t i;
+
+    /* short formulas use the tokens inside the tokenizer */
+    if (length < SMALL_TOKENS)
+        tokenizer->token = tokenizer->small;
+    else if ((tokenizer->token = malloc((length + 1)
+                                        * sizeof(struct Token))) == NULL) {
+        perror("malloc(tokens)");
         exit(EXIT_FAILURE);
     }
 
-    tokenizer->current_token = tokenizer->string;
-    tokenizer->position = 1;
+    t = tokenizer->token;
+    i = 0;
+
+    if (length > 0) {
+        t = add_token(t, string[0], classify(string[0]));
+        i++;
+    }
+#ifdef TOKENIZER_SSE2
+    for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE)
+        t = add_block(t, string, i);
+#endif
+
+    for (; i < length; i++)
+        if (string[i] != ' ')
+            t = add_token(t, string[i], classify(string[i]));
+
+    add_token(t, '\0', TOKEN_END);
 
-    return (tokenizer);
+    tokenizer->current = tokenizer->token;
 }
 
 void free_tokenizer(struct Tokenizer *t)
 {
-    free(t->string);
-    free(t);
+    if (t->token != t->small)
+        free(t->token);
 }
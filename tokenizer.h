@@ -21,17 +21,40 @@
 #ifndef FP_TOKENIZER_H
 #define FP_TOKENIZER_H
 
-#define CURRENT_TOKEN (*(tokenizer->current_token))
-#define SKIP_TOKEN    next_token(tokenizer)
+#include <stddef.h>
 
+/* classes of tokens */
+#define TOKEN_SYMBOL 0          /* operators, braces and everything else */
+#define TOKEN_DIGIT  1
+#define TOKEN_LOWER  2
+#define TOKEN_END    3
+
+/* number of tokens that need no allocation */
+#define SMALL_TOKENS 128
+
+#define CURRENT_TOKEN (tokenizer->current->symbol)
+#define CURRENT_CLASS (tokenizer->current->class)
+
+/* the parser never skips the end token */
+#define SKIP_TOKEN    (tokenizer->current++)
+
+/* position of the current token as counted in error messages */
+#define TOKEN_POSITION(t) ((int) ((t)->current - (t)->token) + 1)
+
+/* a character of the formula that is not a skipped space */
+struct Token {
+    char symbol;
+    unsigned char class;
+};
+
+/* all tokens of a formula, the last one is TOKEN_END */
 struct Tokenizer {
-    char *current_token;
-    char *string;
-    int position;
+    struct Token *token;
+    struct Token *current;
+    struct Token small[SMALL_TOKENS];
 };
 
-extern struct Tokenizer *create_tokenizer(char *);
-extern void next_token(struct Tokenizer *);
+extern void init_tokenizer(struct Tokenizer *, const char *, size_t);
 extern void free_tokenizer(struct Tokenizer *);
 
 #endif